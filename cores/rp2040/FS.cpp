@@ -20,6 +20,7 @@
 
 #include "FS.h"
 #include "FSImpl.h"
+#include <algorithm>
 
 using namespace fs;
 
@@ -79,6 +80,14 @@ int File::read(uint8_t* buf, size_t size) {
     return _p->read(buf, size);
 }
 
+size_t File::mapRegion(const uint8_t **ptr, size_t len) {
+    if (!_p) {
+        return 0;
+    }
+
+    return _p->mapRegion(ptr, len);
+}
+
 int File::peek() {
     if (!_p) {
         return -1;
@@ -141,6 +150,23 @@ bool File::truncate(uint32_t size) {
     return _p->truncate(size);
 }
 
+bool File::preallocate(size_t size) {
+    if (!_p) {
+        return false;
+    }
+
+    return _p->preallocate(size);
+}
+
+bool File::setBufferSize(size_t size) {
+    if (!_p || !size) {
+        return false;
+    }
+
+    _p = std::make_shared<BufferedFileImpl>(_p, size);
+    return true;
+}
+
 const char* File::name() const {
     if (!_p) {
         return nullptr;
@@ -225,6 +251,130 @@ void File::setTimeCallback(time_t (*cb)(void)) {
     _timeCallback = cb;
 }
 
+BufferedFileImpl::BufferedFileImpl(FileImplPtr file, size_t size) : _file(file), _size(size) {
+    _buf = new uint8_t[size];
+}
+
+BufferedFileImpl::~BufferedFileImpl() {
+    _sync();
+    delete[] _buf;
+}
+
+// Passes on any buffered writes, or gives back unread read-ahead, leaving the underlying
+// file at the position the user sees and the buffer empty
+bool BufferedFileImpl::_sync() {
+    bool ok = true;
+    if (_writing) {
+        ok = _file->write(_buf, _len) == _len;
+    } else if (_pos < _len) {
+        ok = _file->seek(_file->position() - (_len - _pos), SeekSet);
+    }
+    _len = 0;
+    _pos = 0;
+    _writing = false;
+    return ok;
+}
+
+size_t BufferedFileImpl::write(const uint8_t *buf, size_t size) {
+    if ((!_writing || (_len + size > _size)) && !_sync()) {
+        return 0;
+    }
+    if (size >= _size) {
+        return _file->write(buf, size);
+    }
+    memcpy(_buf + _len, buf, size);
+    _len += size;
+    _writing = true;
+    return size;
+}
+
+int BufferedFileImpl::read(uint8_t* buf, size_t size) {
+    if (_writing && !_sync()) {
+        return 0;
+    }
+    size_t done = 0;
+    while (done < size) {
+        if (_pos == _len) {
+            if (size - done >= _size) {
+                _len = 0;
+                _pos = 0;
+                int r = _file->read(buf + done, size - done);
+                done += (r > 0) ? r : 0;
+                break;
+            }
+            int r = _file->read(_buf, _size);
+            _len = (r > 0) ? r : 0;
+            _pos = 0;
+            if (!_len) {
+                break;
+            }
+        }
+        size_t n = std::min(size - done, _len - _pos);
+        memcpy(buf + done, _buf + _pos, n);
+        _pos += n;
+        done += n;
+    }
+    return done;
+}
+
+size_t BufferedFileImpl::mapRegion(const uint8_t **ptr, size_t len) {
+    if (!_sync()) {
+        return 0;
+    }
+    return _file->mapRegion(ptr, len);
+}
+
+void BufferedFileImpl::flush() {
+    _sync();
+    _file->flush();
+}
+
+bool BufferedFileImpl::seek(uint32_t pos, SeekMode mode) {
+    if (mode == SeekCur) {
+        pos = position() + (int32_t)pos;
+        mode = SeekSet;
+    }
+    if (!_writing && (mode == SeekSet)) {
+        // Moving around inside the read-ahead, e.g. for peek(), needn't touch the file
+        size_t start = _file->position() - _len;
+        if ((pos >= start) && (pos <= start + _len)) {
+            _pos = pos - start;
+            return true;
+        }
+    }
+    if (!_sync()) {
+        return false;
+    }
+    return _file->seek(pos, mode);
+}
+
+size_t BufferedFileImpl::position() const {
+    return _writing ? _file->position() + _len : _file->position() - (_len - _pos);
+}
+
+size_t BufferedFileImpl::size() const {
+    return _writing ? std::max(_file->size(), position()) : _file->size();
+}
+
+bool BufferedFileImpl::truncate(uint32_t size) {
+    if (!_sync()) {
+        return false;
+    }
+    return _file->truncate(size);
+}
+
+bool BufferedFileImpl::preallocate(size_t size) {
+    if (!_sync()) {
+        return false;
+    }
+    return _file->preallocate(size);
+}
+
+void BufferedFileImpl::close() {
+    _sync();
+    _file->close();
+}
+
 File Dir::openFile(const char* mode) {
     if (!_impl) {
         return File();
@@ -352,6 +502,13 @@ bool FS::check() {
     return _impl->check();
 }
 
+bool FS::sync() {
+    if (!_impl) {
+        return false;
+    }
+    return _impl->sync();
+}
+
 bool FS::format() {
     if (!_impl) {
         return false;
@@ -68,6 +68,11 @@ public:
         return read((uint8_t*)buffer, length);
     }
     int read(uint8_t* buf, size_t size);
+    // Points *ptr at the next bytes of the file in memory-mapped flash and moves past them,
+    // instead of copying them.  Returns how many of the len bytes are there, which can stop
+    // short at a flash block, or 0 if this file can't be mapped and read() is needed.  The
+    // pointer is only good until the filesystem is next written to.
+    size_t mapRegion(const uint8_t **ptr, size_t len);
     bool seek(uint32_t pos, SeekMode mode);
     bool seek(uint32_t pos) {
         return seek(pos, SeekSet);
@@ -82,6 +87,12 @@ public:
     const char* name() const;
     const char* fullName() const; // Includes path
     bool truncate(uint32_t size);
+    // Reserves size bytes of contiguous, pre-erased space for an empty file to be written
+    // into, where the filesystem supports it (SDFS)
+    bool preallocate(size_t size);
+    // Buffers this file's small reads and writes in size bytes of RAM, flushed on seek(),
+    // flush() and close().  Call right after opening, as earlier copies of the File bypass it
+    bool setBufferSize(size_t size);
 
     bool isFile() const;
     bool isDirectory() const;
@@ -227,6 +238,8 @@ public:
     // Low-level FS routines, not needed by most applications
     bool gc();
     bool check();
+    // Writes out anything the filesystem is holding back in RAM
+    bool sync();
 
     time_t getCreationTime();
 
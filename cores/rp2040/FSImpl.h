@@ -31,6 +31,11 @@ public:
     virtual ~FileImpl() { }
     virtual size_t write(const uint8_t *buf, size_t size) = 0;
     virtual int read(uint8_t* buf, size_t size) = 0;
+    virtual size_t mapRegion(const uint8_t **ptr, size_t len) {
+        (void) ptr;
+        (void) len;
+        return 0;    // Default is to not support mapping
+    }
     virtual void flush() = 0;
     virtual bool seek(uint32_t pos, SeekMode mode) = 0;
     virtual size_t position() const = 0;
@@ -39,6 +44,10 @@ public:
         return 0;
     }
     virtual bool truncate(uint32_t size) = 0;
+    virtual bool preallocate(size_t size) {
+        (void) size;
+        return false;    // Default is to not support preallocation
+    }
     virtual void close() = 0;
     virtual const char* name() const = 0;
     virtual const char* fullName() const = 0;
@@ -67,6 +76,59 @@ protected:
     time_t (*_timeCallback)(void) = nullptr;
 };
 
+// Puts a RAM buffer in front of another FileImpl, so runs of small reads are served from one
+// larger read-ahead and runs of small writes go out as one larger write.  Reads and writes of
+// at least the buffer size skip it.  See File::setBufferSize()
+class BufferedFileImpl : public FileImpl {
+public:
+    BufferedFileImpl(FileImplPtr file, size_t size);
+    ~BufferedFileImpl() override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int read(uint8_t* buf, size_t size) override;
+    size_t mapRegion(const uint8_t **ptr, size_t len) override;
+    void flush() override;
+    bool seek(uint32_t pos, SeekMode mode) override;
+    size_t position() const override;
+    size_t size() const override;
+    int availableForWrite() override {
+        return _file->availableForWrite();
+    }
+    bool truncate(uint32_t size) override;
+    bool preallocate(size_t size) override;
+    void close() override;
+    const char* name() const override {
+        return _file->name();
+    }
+    const char* fullName() const override {
+        return _file->fullName();
+    }
+    bool isFile() const override {
+        return _file->isFile();
+    }
+    bool isDirectory() const override {
+        return _file->isDirectory();
+    }
+    void setTimeCallback(time_t (*cb)(void)) override {
+        _file->setTimeCallback(cb);
+    }
+    time_t getLastWrite() override {
+        return _file->getLastWrite();
+    }
+    time_t getCreationTime() override {
+        return _file->getCreationTime();
+    }
+
+protected:
+    bool _sync();
+
+    FileImplPtr _file;
+    uint8_t    *_buf;
+    size_t      _size;
+    size_t      _len = 0;         // Bytes in _buf
+    size_t      _pos = 0;         // Next read-ahead byte in _buf
+    bool        _writing = false; // _buf holds writes not yet passed on, not read-ahead
+};
+
 enum OpenMode {
     OM_DEFAULT = 0,
     OM_CREATE = 1,
@@ -133,6 +195,9 @@ public:
     virtual bool check() {
         return true;    // May not be implemented in all file systems.
     }
+    virtual bool sync() {
+        return true;    // May not be implemented in all file systems.
+    }
     virtual time_t getCreationTime() {
         return 0;    // May not be implemented in all file systems.
     }
@@ -48,6 +48,7 @@ public:
             return;
         }
         mutex_init(&_idleMutex);
+        _ramLock = spin_lock_instance(spin_lock_claim_unused(true));
         queue_init(&_queue[0], sizeof(uint32_t), FIFOCNT);
         queue_init(&_queue[1], sizeof(uint32_t), FIFOCNT);
         _multicore = true;
@@ -96,6 +97,15 @@ public:
             vTaskSuspendAll();
         }
         mutex_enter_blocking(&_idleMutex);
+        // An other core running only from RAM can keep going, it will wait in exitRAMOnly()
+        // if it tries to leave before we're done
+        int other = get_core_num() ^ 1;
+        uint32_t save = spin_lock_blocking(_ramLock);
+        _flashBusy[other] = _ramOnly[other];
+        spin_unlock(_ramLock, save);
+        if (_flashBusy[other]) {
+            return;
+        }
         __otherCoreIdled = false;
         multicore_fifo_push_blocking(_GOTOSLEEP);
         while (!__otherCoreIdled) { /* noop */ }
@@ -105,6 +115,7 @@ public:
         if (!_multicore) {
             return;
         }
+        _flashBusy[get_core_num() ^ 1] = false;
         mutex_exit(&_idleMutex);
         __otherCoreIdled = false;
         if (__isFreeRTOS) {
@@ -117,6 +128,33 @@ public:
         // once __otherCoreIdled == false.
     }
 
+    // Between these, this core promises to run only code and interrupt handlers in RAM, so
+    // the other core's flash writes can leave it running instead of idling it
+    void __no_inline_not_in_flash_func(enterRAMOnly)() {
+        if (!_multicore) {
+            return;
+        }
+        uint32_t save = spin_lock_blocking(_ramLock);
+        _ramOnly[get_core_num()] = true;
+        spin_unlock(_ramLock, save);
+    }
+
+    void __no_inline_not_in_flash_func(exitRAMOnly)() {
+        if (!_multicore) {
+            return;
+        }
+        int core = get_core_num();
+        while (true) {
+            uint32_t save = spin_lock_blocking(_ramLock);
+            if (!_flashBusy[core]) {
+                _ramOnly[core] = false;
+                spin_unlock(_ramLock, save);
+                return;
+            }
+            spin_unlock(_ramLock, save);
+        }
+    }
+
     void clear() {
         uint32_t val;
 
@@ -147,6 +185,9 @@ private:
 
     bool _multicore = false;
     mutex_t _idleMutex;
+    spin_lock_t *_ramLock = nullptr;
+    volatile bool _ramOnly[2] = { false, false };   // Core is between enter/exitRAMOnly()
+    volatile bool _flashBusy[2] = { false, false }; // Core was left running by idleOtherCore()
     queue_t _queue[2];
     static constexpr uint32_t _GOTOSLEEP = 0xC0DED02E;
 };
@@ -297,6 +338,15 @@ public:
         fifo.resumeOtherCore();
     }
 
+    // Code on this core between these must run, and take interrupts, only from RAM
+    void __no_inline_not_in_flash_func(enterRAMOnly)() {
+        fifo.enterRAMOnly();
+    }
+
+    void __no_inline_not_in_flash_func(exitRAMOnly)() {
+        fifo.exitRAMOnly();
+    }
+
     void restartCore1() {
         multicore_reset_core1();
         fifo.clear();
@@ -21,9 +21,13 @@
 
 #include <stdint.h>
 
+// Describes the command page understood by the prebuilt OTA shim in lib/ota.o, so this can
+// lag ota/ota_command.h, which is copied over it once lib/ota.o is rebuilt with make-ota.sh.
 #define _OTA_WRITE 1
 #define _OTA_VERIFY 1
 
+#define _OTA_MAX_COMMANDS 8
+
 typedef struct {
     uint32_t command;
     union {
@@ -42,7 +46,7 @@ typedef struct {
 
     // List of operations
     uint32_t count;
-    commandEntry cmd[8];
+    commandEntry cmd[_OTA_MAX_COMMANDS];
 
     uint32_t crc32; // CRC32 over just the contents of this struct, up until just before this value
 } OTACmdPage;
@@ -40,6 +40,13 @@
 //#endif
 #define OTA_DEBUG Serial
 
+// Protocol 2, negotiated in the invitation: the host keeps up to OTA_WINDOW bytes in flight,
+// written in OTA_CHUNK pieces to match the Updater buffer, and each OTA_CHUNK received is
+// acknowledged with the cumulative byte count instead of a reply to every packet
+#define OTA_PROTOCOL 2
+#define OTA_CHUNK    4096
+#define OTA_WINDOW   (4 * OTA_CHUNK)
+
 ArduinoOTAClass::ArduinoOTAClass() {
 }
 
@@ -202,6 +209,17 @@ void ArduinoOTAClass::_onRx() {
         if (_md5.length() != 32) {
             return;
         }
+        // Newer hosts offer a protocol and a GZIP copy of the image on a second line, which
+        // older devices never read.  Legacy hosts end the packet after the MD5.
+        _proto = _udp_ota->getSize() ? parseInt() : 0;
+        _zsize = 0;
+        _zmd5 = "";
+        if (_proto >= OTA_PROTOCOL) {
+            _zsize = parseInt();
+            _udp_ota->read();
+            _zmd5 = readStringUntil('\n');
+            _zmd5.trim();
+        }
 
         ota_ip = _ota_ip;
 
@@ -277,6 +295,13 @@ void ArduinoOTAClass::_runUpdate() {
         return;
     }
 
+    // Images staged in LittleFS are decompressed by the OTA bootloader
+    bool gzip = (_proto >= OTA_PROTOCOL) && (_zsize > 0) && (_zmd5.length() == 32) && Update.staged(_cmd);
+    if (gzip) {
+        _size = _zsize;
+        _md5 = _zmd5;
+    }
+
     if (!Update.begin(_size, _cmd)) {
 #ifdef OTA_DEBUG
         OTA_DEBUG.println("Update Begin Error");
@@ -296,7 +321,13 @@ void ArduinoOTAClass::_runUpdate() {
         return;
     }
 
-    _udp_ota->append("OK", 2);
+    if (_proto >= OTA_PROTOCOL) {
+        char ok[32];
+        sprintf(ok, "OK %d %d %d %d", OTA_PROTOCOL, OTA_CHUNK, OTA_WINDOW, gzip ? 1 : 0);
+        _udp_ota->append(ok, strlen(ok));
+    } else {
+        _udp_ota->append("OK", 2);
+    }
     _udp_ota->send(ota_ip, _ota_udp_port);
     delay(100);
 
@@ -323,7 +354,7 @@ void ArduinoOTAClass::_runUpdate() {
     // OTA sends little packets
     client.setNoDelay(true);
 
-    uint32_t written, total = 0;
+    uint32_t written, total = 0, acked = 0;
     while (!Update.isFinished() && (client.connected() || client.available())) {
         int waited = 1000;
         while (!client.available() && waited--) {
@@ -341,8 +372,13 @@ void ArduinoOTAClass::_runUpdate() {
         }
         written = Update.write(client);
         if (written > 0) {
-            client.print(written, DEC);
             total += written;
+            if (_proto < OTA_PROTOCOL) {
+                client.print(written, DEC);
+            } else if ((total - acked >= OTA_CHUNK) || Update.isFinished()) {
+                client.printf("A%lu\n", (unsigned long)total);
+                acked = total;
+            }
             if (_progress_callback) {
                 _progress_callback(total, _size);
             }
@@ -351,12 +387,19 @@ void ArduinoOTAClass::_runUpdate() {
 
 
     if (Update.end()) {
-        // Ensure last count packet has been sent out and not combined with the final OK
-        client.flush();
-        delay(1000);
-        client.print("OK");
-        client.flush();
-        delay(1000);
+        if (_proto >= OTA_PROTOCOL) {
+            // Replies are whole lines, so the OK can't run into the last ack
+            client.print("OK\n");
+            client.flush();
+            delay(100);
+        } else {
+            // Ensure last count packet has been sent out and not combined with the final OK
+            client.flush();
+            delay(1000);
+            client.print("OK");
+            client.flush();
+            delay(1000);
+        }
         client.stop();
 #ifdef OTA_DEBUG
         OTA_DEBUG.printf("Update Success\n");
@@ -112,6 +112,9 @@ private:
     uint16_t _ota_udp_port = 0;
     IPAddress _ota_ip;
     String _md5;
+    int _proto = 0;    // Protocol offered by the host, 0 for the original one
+    int _zsize = 0;    // Size and MD5 of the host's GZIP copy of the image, if any
+    String _zmd5;
 
     THandlerFunction _start_callback = nullptr;
     THandlerFunction _end_callback = nullptr;
@@ -36,11 +36,165 @@
 
 extern "C" uint8_t _EEPROM_start;
 
+// The sector starts with the EEPROM contents as of the last full commit, and in log mode later
+// commits are appended as records growing down from the end of the sector, towards the
+// contents.  Each commit's records are flagged first and last, and a commit only counts once
+// its last record is there with every CRC intact, so one cut short by a reset is ignored.
+// Only when the records no longer fit is the sector erased and rewritten, the same as a
+// normal commit (and, like one, not safe against a reset part way through).
+#define EEPROM_SECTOR   4096
+#define EEPROM_LOG_DATA 24
+#define EEPROM_LOG_FIRST 0x01
+#define EEPROM_LOG_LAST  0x02
+
+typedef struct {
+    uint16_t address;
+    uint8_t length;
+    uint8_t flags;
+    uint8_t data[EEPROM_LOG_DATA];
+    uint32_t crc32;           // Over the preceding fields
+} EEPROMLogRecord;
+
+static uint32_t _crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xffffffff;
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static bool _erased(const void *p, size_t len) {
+    const uint8_t *b = (const uint8_t *)p;
+    while (len--) {
+        if (*b++ != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool _valid(const EEPROMLogRecord *r) {
+    return r->length && (r->length <= EEPROM_LOG_DATA) && (r->crc32 == _crc32((const uint8_t *)r, offsetof(EEPROMLogRecord, crc32)));
+}
+
 EEPROMClass::EEPROMClass(void)
     : _sector(&_EEPROM_start) {
 }
 
-void EEPROMClass::begin(size_t size) {
+// Records fit between the contents and the end of the sector, the first one last
+size_t EEPROMClass::_slots() const {
+    return (EEPROM_SECTOR - _size) / sizeof(EEPROMLogRecord);
+}
+
+static const EEPROMLogRecord *_record(const uint8_t *sector, size_t i) {
+    return (const EEPROMLogRecord *)(sector + EEPROM_SECTOR - (i + 1) * sizeof(EEPROMLogRecord));
+}
+
+// Rebuilds the contents from the sector, and finds where the next commit can be appended
+void EEPROMClass::_load(uint8_t *dst) {
+    memcpy(dst, _sector, _size);
+
+    size_t slots = _slots();
+    size_t i, first = 0;
+    bool intact = false;
+    for (i = 0; i < slots; i++) {
+        const EEPROMLogRecord *r = _record(_sector, i);
+        if (_erased(r, sizeof(*r))) {
+            break;
+        }
+        if (!_valid(r)) {
+            intact = false;
+            continue;
+        }
+        if (r->flags & EEPROM_LOG_FIRST) {
+            first = i;
+            intact = true;
+        }
+        if ((r->flags & EEPROM_LOG_LAST) && intact) {
+            for (size_t j = first; j <= i; j++) {
+                const EEPROMLogRecord *c = _record(_sector, j);
+                if (c->address + c->length <= _size) {
+                    memcpy(dst + c->address, c->data, c->length);
+                }
+            }
+            intact = false;
+        }
+    }
+    _logUsed = i;
+    _logFree = 0;
+    while ((i < slots) && _erased(_record(_sector, i), sizeof(EEPROMLogRecord))) {
+        _logFree++;
+        i++;
+    }
+}
+
+// Next run of changed bytes at or after addr, no longer than one record holds
+static size_t _changed(const uint8_t *a, const uint8_t *b, size_t size, size_t &addr) {
+    while ((addr < size) && (a[addr] == b[addr])) {
+        addr++;
+    }
+    size_t len = 0;
+    for (size_t j = 0; (j < EEPROM_LOG_DATA) && (addr + j < size); j++) {
+        if (a[addr + j] != b[addr + j]) {
+            len = j + 1;
+        }
+    }
+    return len;
+}
+
+// Appends the bytes which differ from the sector, or returns false if they won't fit
+bool EEPROMClass::_append() {
+    uint8_t *flash = new uint8_t[_size];
+    _load(flash);
+
+    size_t count = 0;
+    size_t addr, len;
+    for (addr = 0; (len = _changed(flash, _data, _size, addr)); addr += len) {
+        count++;
+    }
+    if (count > _logFree) {
+        delete[] flash;
+        return false;
+    }
+
+    // Erased bytes program as no change, so each page only needs the new records filled in
+    uint32_t page[FLASH_PAGE_SIZE / sizeof(uint32_t)];
+    size_t n = 0;
+    addr = 0;
+    while (n < count) {
+        size_t slot = _logUsed + n;
+        size_t offset = (EEPROM_SECTOR - (slot + 1) * sizeof(EEPROMLogRecord)) & ~(FLASH_PAGE_SIZE - 1);
+        memset(page, 0xff, sizeof(page));
+        do {
+            len = _changed(flash, _data, _size, addr);
+            EEPROMLogRecord *r = (EEPROMLogRecord *)((uint8_t *)page + EEPROM_SECTOR - (slot + 1) * sizeof(EEPROMLogRecord) - offset);
+            r->address = addr;
+            r->length = len;
+            r->flags = (n == 0 ? EEPROM_LOG_FIRST : 0) | (n == count - 1 ? EEPROM_LOG_LAST : 0);
+            memcpy(r->data, _data + addr, len);
+            r->crc32 = _crc32((const uint8_t *)r, offsetof(EEPROMLogRecord, crc32));
+            addr += len;
+            n++;
+            slot++;
+        } while ((n < count) && ((slot * sizeof(EEPROMLogRecord)) % FLASH_PAGE_SIZE));
+
+        noInterrupts();
+        rp2040.idleOtherCore();
+        flash_range_program((intptr_t)_sector - (intptr_t)XIP_BASE + offset, (const uint8_t *)page, FLASH_PAGE_SIZE);
+        rp2040.resumeOtherCore();
+        interrupts();
+    }
+    _logUsed += count;
+    _logFree -= count;
+
+    delete[] flash;
+    return true;
+}
+
+void EEPROMClass::begin(size_t size, bool log) {
     if ((size <= 0) || (size > 4096)) {
         size = 4096;
     }
@@ -56,8 +210,9 @@ void EEPROMClass::begin(size_t size) {
     }
 
     _size = size;
+    _log = log;
 
-    memcpy(_data, _sector, _size);
+    _load(_data);
 
     _dirty = false; //make sure dirty is cleared in case begin() is called 2nd+ time
 }
@@ -118,12 +273,20 @@ bool EEPROMClass::commit() {
         return false;
     }
 
+    if (_log && _append()) {
+        _dirty = false;
+        return true;
+    }
+
     noInterrupts();
     rp2040.idleOtherCore();
     flash_range_erase((intptr_t)_sector - (intptr_t)XIP_BASE, 4096);
     flash_range_program((intptr_t)_sector - (intptr_t)XIP_BASE, _data, _size);
     rp2040.resumeOtherCore();
     interrupts();
+    _logUsed = 0;
+    _logFree = _slots();
+    _dirty = false;
 
     return true;
 }
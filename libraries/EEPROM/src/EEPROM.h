@@ -29,7 +29,9 @@ class EEPROMClass {
 public:
     EEPROMClass(void);
 
-    void begin(size_t size);
+    // With log set, commit() appends just the changed bytes to the sector and only erases it
+    // once there is no room left, see EEPROM.cpp
+    void begin(size_t size, bool log = false);
     uint8_t read(int const address);
     void write(int const address, uint8_t const val);
     bool commit();
@@ -77,10 +79,17 @@ public:
     }
 
 protected:
+    void _load(uint8_t *dst);
+    bool _append();
+    size_t _slots() const;
+
     uint8_t* _sector;
     uint8_t* _data = nullptr;
     size_t _size = 0;
     bool _dirty = false;
+    bool _log = false;
+    size_t _logUsed = 0;  // Log records already in the sector, including any torn ones
+    size_t _logFree = 0;  // Erased records after them
 };
 
 extern EEPROMClass EEPROM;
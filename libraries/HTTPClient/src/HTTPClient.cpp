@@ -52,26 +52,6 @@ const String HTTPClient::defaultUserAgent = defaultUserAgentPstr;
 //    return 0; // never reached, keep gcc quiet
 //}
 
-// Wrappers for ESP8266-specific Arduino API changes
-static size_t StreamSendSize(Stream *s, Print *c, int size) {
-    int sent = 0;
-    if (size < 0) {
-        size = 999999; // Transfer until read fails
-    }
-    uint32_t start = millis();
-    while ((sent < size) && (millis() - start < 5000)) {
-        int x = s->read();
-        if (x < 0) {
-            break;
-        } else if (c->write(x)) {
-            sent++;
-        } else {
-            break;
-        }
-    }
-    return sent;
-}
-
 class StreamConstPtr {
 public:
     StreamConstPtr(const uint8_t *payload, size_t size) {
@@ -82,17 +62,22 @@ public:
         _payload = (const uint8_t *)string.c_str();
         _size = string.length();
     }
-    size_t sendAll(Client *dst) {
-        uint32_t start = millis();
+    // Hand the whole remainder to the client each time, letting it split into MSS-sized segments,
+    // and only give up after timeout ms without any forward progress
+    size_t sendAll(Client *dst, uint32_t timeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT) {
+        uint32_t lastProgress = millis();
         size_t sent = 0;
-        while ((sent < _size) && (millis() - start < 5000)) {
-            size_t towrite = std::min((size_t)128, _size - sent);
-            auto wrote = dst->write(_payload, towrite);
-            if (wrote <= 0) {
+        while (sent < _size) {
+            auto wrote = dst->write(_payload, _size - sent);
+            if (wrote > 0) {
+                sent += wrote;
+                _payload += wrote;
+                lastProgress = millis();
+            } else if (!dst->connected() || (millis() - lastProgress >= timeout)) {
                 break;
+            } else {
+                yield();
             }
-            sent += wrote;
-            _payload += wrote;
         }
         return sent;
     }
@@ -100,6 +85,423 @@ public:
     size_t _size;
 };
 
+// Write an entire block to the destination, retrying short writes until timeout ms pass with no progress
+static size_t WriteBlock(Print *dst, const uint8_t *buf, size_t len, uint32_t timeout) {
+    uint32_t lastProgress = millis();
+    size_t sent = 0;
+    while (sent < len) {
+        size_t wrote = dst->write(buf + sent, len - sent);
+        if (wrote > 0) {
+            sent += wrote;
+            lastProgress = millis();
+        } else if (millis() - lastProgress >= timeout) {
+            break;
+        } else {
+            yield();
+        }
+    }
+    return sent;
+}
+
+// Feed whatever the connection has buffered to an incremental parser, stopping as soon as it is
+// done so nothing past its end (i.e. the body) is consumed.  Returns true if any bytes were used.
+template<typename Parser>
+static bool FeedParser(WiFiClient *client, Parser &parser) {
+    bool fed = false;
+    while (!parser.done()) {
+        if (client->hasPeekBufferAPI()) {
+            size_t avail = client->peekAvailable();
+            if (!avail) {
+                break;
+            }
+            client->peekConsume(parser.feed(client->peekBuffer(), avail));
+        } else {
+            int c = (client->available() > 0) ? client->read() : -1;
+            if (c < 0) {
+                break;
+            }
+            char ch = c;
+            parser.feed(&ch, 1);
+        }
+        fed = true;
+    }
+    return fed;
+}
+
+// Feed the parser until it is done, the connection drops, or no data arrives for timeout ms
+template<typename Parser>
+static int RunParser(WiFiClient *client, Parser &parser, uint32_t timeout) {
+    uint32_t lastData = millis();
+    while (!parser.done()) {
+        if (FeedParser(client, parser)) {
+            lastData = millis();
+            continue;
+        }
+        if (!client->connected()) {
+            return HTTPC_ERROR_CONNECTION_LOST;
+        }
+        if (millis() - lastData > timeout) {
+            return HTTPC_ERROR_READ_TIMEOUT;
+        }
+        yield();
+    }
+    return 0;
+}
+
+// Discards everything, used to skip response bodies nobody read
+class NullPrint : public Print {
+public:
+    size_t write(uint8_t) override {
+        return 1;
+    }
+    size_t write(const uint8_t *, size_t len) override {
+        return len;
+    }
+};
+
+/**
+    Parses the status line and headers a byte at a time with fixed-size scratch buffers.
+    Only the headers HTTPClient acts on and the ones requested by collectHeaders() are
+    examined, so the only heap use is storing the values of Location and collected headers.
+*/
+class HTTPClient::HeaderParser {
+public:
+    enum { TE_NONE, TE_CHUNKED, TE_OTHER };
+
+    HeaderParser(HTTPClient &http) : _http(http) { }
+
+    bool done() const {
+        return _done;
+    }
+
+    int transferEncoding() const {
+        return _te;
+    }
+
+    // Returns the number of bytes used, stopping right after the blank line ending the headers
+    size_t feed(const char *data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            char c = data[i];
+            if (c == '\n') {
+                endLine();
+                if (_done) {
+                    return i + 1;
+                }
+                continue;
+            }
+            switch (_state) {
+            case NAME:
+                if (c == ':') {
+                    startValue();
+                } else if (c == ' ') {
+                    // Header names can't contain spaces, so this is either the status line or garbage
+                    _state = (_nameLen == 8) && !strncmp(_name, "HTTP/1.", 7) ? STATUS : SKIP;
+                    _code = 0;
+                } else if (c != '\r') {
+                    if (_nameLen < sizeof(_name) - 1) {
+                        _name[_nameLen] = c;
+                    } else {
+                        putLongName(c);
+                    }
+                    _nameLen++;
+                }
+                break;
+            case STATUS:
+                if ((c >= '0') && (c <= '9')) {
+                    _code = _code * 10 + (c - '0');
+                } else if (_code) {
+                    endStatus();
+                }
+                break;
+            case VALUE:
+                if ((c == ' ' || c == '\t') && !_valLen && !_spilled) {
+                    break; // Leading whitespace
+                }
+                if (c != '\r') {
+                    putValue(c);
+                }
+                break;
+            case SKIP:
+                break;
+            }
+        }
+        return len;
+    }
+
+private:
+    enum { NAME, STATUS, VALUE, SKIP } _state = NAME;
+    enum { H_NONE, H_CONTENT_LENGTH, H_CONNECTION, H_TRANSFER_ENCODING, H_LOCATION } _header = H_NONE;
+
+    void startValue() {
+        _header = H_NONE;
+        _collect = -1;
+        _valLen = 0;
+        _spilled = false;
+        if (_nameLen >= sizeof(_name)) {
+            // Longer than anything HTTPClient acts on, but may still be collected
+            if (_long >= 0) {
+                const char *seen = _http._currentHeaders[_long].key.c_str();
+                for (size_t i = 0; i < _http._headerKeysCount; i++) {
+                    const String &key = _http._currentHeaders[i].key;
+                    if ((key.length() == _nameLen) && !strncasecmp(key.c_str(), seen, _nameLen)) {
+                        collect(i);
+                        break;
+                    }
+                }
+            }
+            _state = (_collect >= 0) ? VALUE : SKIP;
+            return;
+        }
+        _name[_nameLen] = 0;
+        switch (_nameLen) {
+        case 8:
+            if (!strcasecmp(_name, "Location")) {
+                _header = H_LOCATION;
+                _http._location = "";
+            }
+            break;
+        case 10:
+            if (!strcasecmp(_name, "Connection")) {
+                _header = H_CONNECTION;
+            }
+            break;
+        case 14:
+            if (!strcasecmp(_name, "Content-Length")) {
+                _header = H_CONTENT_LENGTH;
+            }
+            break;
+        case 17:
+            if (!strcasecmp(_name, "Transfer-Encoding")) {
+                _header = H_TRANSFER_ENCODING;
+            }
+            break;
+        }
+        for (size_t i = 0; i < _http._headerKeysCount; i++) {
+            const String &key = _http._currentHeaders[i].key;
+            if ((key.length() == _nameLen) && !strcasecmp(key.c_str(), _name)) {
+                collect(i);
+                break; // We found a match, stop looking
+            }
+        }
+        _state = (_header != H_NONE) || (_collect >= 0) ? VALUE : SKIP;
+    }
+
+    void collect(int i) {
+        _collect = i;
+        if (_http._currentHeaders[i].value.length()) {
+            // Existing value, append this one with a comma
+            _http._currentHeaders[i].value += ',';
+        }
+    }
+
+    // Past the end of _name, a name is followed through the collected keys instead: _long is
+    // one which matches everything read so far, or -1 once none does
+    void putLongName(char c) {
+        const char *seen;
+        if (_nameLen == sizeof(_name) - 1) {
+            seen = _name;
+        } else if (_long >= 0) {
+            const String &key = _http._currentHeaders[_long].key;
+            if ((key.length() > _nameLen) && (tolower(key[_nameLen]) == tolower(c))) {
+                return;
+            }
+            seen = key.c_str();
+        } else {
+            return;
+        }
+        _long = -1;
+        for (size_t i = 0; i < _http._headerKeysCount; i++) {
+            const String &key = _http._currentHeaders[i].key;
+            if ((key.length() > _nameLen) && (tolower(key[_nameLen]) == tolower(c)) && !strncasecmp(key.c_str(), seen, _nameLen)) {
+                _long = i;
+                return;
+            }
+        }
+    }
+
+    void putValue(char c) {
+        if (_valLen == sizeof(_val) - 1) {
+            if ((_header != H_LOCATION) && (_collect < 0)) {
+                return; // Only the prefix matters for the scalar headers
+            }
+            spillValue();
+        }
+        _val[_valLen++] = c;
+    }
+
+    // Move the scratch value into the Strings that store it
+    void spillValue() {
+        if (_header == H_LOCATION) {
+            _http._location.concat(_val, _valLen);
+        }
+        if (_collect >= 0) {
+            _http._currentHeaders[_collect].value.concat(_val, _valLen);
+        }
+        _spilled = true;
+        _valLen = 0;
+    }
+
+    void endValue() {
+        if ((_header == H_LOCATION) || (_collect >= 0)) {
+            spillValue();
+            if (_header == H_LOCATION) {
+                _http._location.trim();
+            }
+            if (_collect >= 0) {
+                _http._currentHeaders[_collect].value.trim();
+            }
+            return;
+        }
+        while (_valLen && (_val[_valLen - 1] == ' ' || _val[_valLen - 1] == '\t')) {
+            _valLen--;
+        }
+        _val[_valLen] = 0;
+        switch (_header) {
+        case H_CONTENT_LENGTH:
+            _http._size = atoi(_val);
+            break;
+        case H_CONNECTION:
+            if (strstr(_val, "close") && !strstr(_val, "keep-alive")) {
+                _http._canReuse = false;
+                _http._serverClose = true;
+            }
+            break;
+        case H_TRANSFER_ENCODING:
+            if (!_valLen) {
+                _te = TE_NONE;
+            } else {
+                _te = !strcasecmp(_val, "chunked") ? TE_CHUNKED : TE_OTHER;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void endStatus() {
+        _http._canReuse = _http._canReuse && (_name[7] != '0');
+        _http._returnCode = _code;
+        _http._canReuse = _http._canReuse && (_code > 0) && (_code < 500);
+        _state = SKIP;
+    }
+
+    void endLine() {
+        if ((_state == NAME) && !_nameLen) {
+            _done = true;
+        } else if (_state == STATUS) {
+            endStatus();
+        } else if (_state == VALUE) {
+            endValue();
+        }
+        _state = NAME;
+        _nameLen = 0;
+        _long = -1;
+    }
+
+    HTTPClient &_http;
+    char _name[48];
+    size_t _nameLen = 0;
+    int _long = -1;
+    char _val[64];
+    size_t _valLen = 0;
+    bool _spilled = false;
+    int _collect = -1;
+    int _code = 0;
+    int _te = TE_NONE;
+    bool _done = false;
+};
+
+/**
+    Parses a chunk-size line, "<hex size>[;extensions]\r\n", ignoring any extensions
+*/
+class HTTPClient::ChunkParser {
+public:
+    bool done() const {
+        return _done;
+    }
+
+    bool valid() const {
+        return !_overflow;
+    }
+
+    int size() const {
+        return _size;
+    }
+
+    size_t feed(const char *data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            char c = data[i];
+            if (c == '\n') {
+                _done = true;
+                return i + 1;
+            }
+            if (_inSize) {
+                int v = hexValue(c);
+                if (v < 0) {
+                    _inSize = false; // \r, whitespace or extension
+                } else if (_size > 0x7ffffff) {
+                    _overflow = true;
+                } else {
+                    _size = (_size << 4) | v;
+                }
+            }
+        }
+        return len;
+    }
+
+private:
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    int _size = 0;
+    bool _inSize = true;
+    bool _overflow = false;
+    bool _done = false;
+};
+
+/**
+    Skips the trailer fields after the last chunk, up to the empty line ending the body
+*/
+class HTTPClient::TrailerParser {
+public:
+    bool done() const {
+        return _done;
+    }
+
+    size_t feed(const char *data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            char c = data[i];
+            if (c == '\n') {
+                if (_empty) {
+                    _done = true;
+                    return i + 1;
+                }
+                _empty = true;
+            } else if (c != '\r') {
+                _empty = false;
+            }
+        }
+        return len;
+    }
+
+private:
+    bool _empty = true;
+    bool _done = false;
+};
+
+// Out of line so the incomplete HeaderParser type can be held in a unique_ptr
+HTTPClient::HTTPClient() = default;
+HTTPClient::~HTTPClient() = default;
+HTTPClient::HTTPClient(HTTPClient&&) = default;
+HTTPClient& HTTPClient::operator=(HTTPClient&&) = default;
 
 void HTTPClient::clear() {
     _returnCode = 0;
@@ -328,6 +730,18 @@ bool HTTPClient::beginInternal(const String& __url, const char* expectedProtocol
     called after the payload is handled
 */
 void HTTPClient::end(void) {
+    // A pooled connection goes to whoever asks next, who would read the rest of a body still
+    // on its way as their response
+    if (_pool && _clientMade && _reuse && _canReuse && _bodyDone && connected() && !_clientMade->available()) {
+        DEBUG_HTTPCLIENT("[HTTP-Client][end] returning connection to pool\n");
+        uint8_t auth[32];
+        if (_clientTLS) {
+            _tls()->getAuthSettingsHash(auth);
+        }
+        _pool->release(_clientMade, _host, _port, _clientTLS, _poolTag, _clientTLS ? auth : nullptr);
+        _clientMade = nullptr;
+        _clientTLS = false;
+    }
     disconnect(false);
     clear();
     if (_clientMade) {
@@ -343,7 +757,8 @@ void HTTPClient::end(void) {
 */
 void HTTPClient::disconnect(bool preserveClient) {
     if (connected()) {
-        if (_client()->available() > 0) {
+        // Pipelined responses may already be waiting behind the current one
+        if (!(_pipelining && _reuse && _canReuse) && (_client()->available() > 0)) {
             DEBUG_HTTPCLIENT("[HTTP-Client][end] still data in buffer (%d), clean up.\n", _client()->available());
             while (_client()->available() > 0) {
                 _client()->read();
@@ -400,6 +815,18 @@ void HTTPClient::setReuse(bool reuse) {
     _reuse = reuse;
 }
 
+/**
+    lend and return keep-alive connections through a pool shared by all HTTPClients.
+    Only connections created by the HTTPClient itself (not ones passed to begin()) are pooled.
+    @param pool HTTPConnectionPool, nullptr disables pooling
+    @param tlsTag uint32_t extra key for pooled connections.  HTTPS connections are already only
+                  shared between clients with identical TLS settings.
+*/
+void HTTPClient::setConnectionPool(HTTPConnectionPool *pool, uint32_t tlsTag) {
+    _pool = pool;
+    _poolTag = tlsTag;
+}
+
 /**
     set User Agent
     @param userAgent const char
@@ -596,7 +1023,7 @@ int HTTPClient::sendRequest(const char * type, const uint8_t * payload, size_t s
         }
 
         // transfer all of it, with send-timeout
-        if (size && StreamConstPtr(payload, size).sendAll(_client()) != size) {
+        if (size && StreamConstPtr(payload, size).sendAll(_client(), _tcpTimeout) != size) {
             return returnError(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
         }
 
@@ -665,6 +1092,10 @@ int HTTPClient::sendRequest(const char * type, const uint8_t * payload, size_t s
         }
     } while (redirect);
 
+    if (!strcmp(type, "HEAD")) {
+        _bodyDone = true;
+    }
+
     // handle Server Response (Header)
     return returnError(code);
 }
@@ -697,14 +1128,225 @@ int HTTPClient::sendRequest(const char * type, Stream * stream, size_t size) {
     }
 
     // transfer all of it, with timeout
-    size_t transferred = StreamSendSize(stream, _client(), size);
+    size_t transferred = sendBody(stream, size);
     if (transferred != size) {
         DEBUG_HTTPCLIENT("[HTTP-Client][sendRequest] short write, asked for %zu but got %zu failed.\n", size, transferred);
         return returnError(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
     }
 
     // handle Server Response (Header)
-    return returnError(handleHeaderResponse());
+    int code = handleHeaderResponse();
+    if (!strcmp(type, "HEAD")) {
+        _bodyDone = true;
+    }
+    return returnError(code);
+}
+
+/**
+    queue a request to be pipelined with others on the same connection
+    @param type const char *     "GET", "POST", ....
+    @param uri String            path to request, empty for the one given to begin()
+    @param payload const uint8_t * data for the message body, copied
+    @param size size_t           size for the message body
+    @param cb                    called with (request id, http code) once the response arrives
+    @return request id, or negative on error
+*/
+int HTTPClient::queueRequest(const char * type, const String& uri, const uint8_t * payload, size_t size, THandlerFunction_Response cb) {
+    QueuedRequest r;
+    r.id = _nextRequestId++;
+    r.type = type;
+    r.uri = uri.length() ? uri : _uri;
+    r.headers = _headers;
+    r.size = (payload && size) ? size : 0;
+    if (r.size) {
+        r.payload.reset(new (std::nothrow) uint8_t[r.size]);
+        if (!r.payload) {
+            return HTTPC_ERROR_TOO_LESS_RAM;
+        }
+        memcpy(r.payload.get(), payload, r.size);
+    }
+    r.cb = std::move(cb);
+    int id = r.id;
+    _queue.push_back(std::move(r));
+    _headers = "";
+    return id;
+}
+
+int HTTPClient::queueRequest(const char * type, const String& uri, const String& payload, THandlerFunction_Response cb) {
+    return queueRequest(type, uri, (const uint8_t *) payload.c_str(), payload.length(), cb);
+}
+
+/**
+    set how many queued requests may be sent before their responses arrive
+    @param depth uint8_t, 1 disables pipelining
+*/
+void HTTPClient::setPipelineDepth(uint8_t depth) {
+    _pipelineDepth = depth ? depth : 1;
+}
+
+/**
+    make sure we're connected and send queued requests until the pipeline is full
+    @return false if the connection or a send failed
+*/
+bool HTTPClient::pipelineSend() {
+    if (!_queueSent && !(_reuse && _canReuse && connected())) {
+        if (!connect()) {
+            // Nothing is on the wire, so only the next request fails
+            _queueSent = 1;
+            pipelineFail(HTTPC_ERROR_CONNECTION_FAILED);
+            return false;
+        }
+        _queueLastData = millis();
+    }
+    const String uri = _uri;
+    const String headers = _headers;
+    bool ok = true;
+    while (ok && (_queueSent < _queue.size()) && (_queueSent < _pipelineDepth)) {
+        QueuedRequest &r = _queue[_queueSent];
+        _uri = r.uri;
+        _headers = r.headers;
+        // Methods without a body don't get a Content-Length, which some servers reject
+        if (r.size || (r.type == "POST") || (r.type == "PUT") || (r.type == "PATCH")) {
+            addHeader(F("Content-Length"), String(r.size));
+        }
+        ok = sendHeader(r.type.c_str()) &&
+             (!r.size || (StreamConstPtr(r.payload.get(), r.size).sendAll(_client(), _tcpTimeout) == r.size));
+        // The body is kept until the response arrives, in case the request has to be sent again
+        _queueSent++;
+        _queueLastData = millis();
+    }
+    _uri = uri;
+    _headers = headers;
+    if (!ok) {
+        pipelineFail(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+    }
+    return ok;
+}
+
+/**
+    report an error to every request already sent and close the connection.  Unsent
+    requests stay queued and will go out on a new connection.  (After a "Connection: close"
+    response the requests behind it are resent instead, see pipelineFinish().)
+    @param error int
+*/
+void HTTPClient::pipelineFail(int error) {
+    DEBUG_HTTPCLIENT("[HTTP-Client][pipeline] failing %zu requests: %d\n", _queueSent, error);
+    _queueParser.reset();
+    _canReuse = false;
+    returnError(error);
+    while (_queueSent) {
+        QueuedRequest r = std::move(_queue.front());
+        _queue.pop_front();
+        _queueSent--;
+        if (r.cb) {
+            r.cb(r.id, error);
+        }
+    }
+}
+
+/**
+    hand the response at the head of the pipeline to its callback and skip any unread body
+    @param code int http code of the parsed response header
+*/
+void HTTPClient::pipelineFinish(int code) {
+    QueuedRequest r = std::move(_queue.front());
+    _queue.pop_front();
+    _queueSent--;
+    _pipelining = true;
+    // HEAD, 1xx, 204 and 304 responses never have a body, whatever their headers say
+    _bodyRead = (code < 200) || (code == HTTP_CODE_NO_CONTENT) || (code == HTTP_CODE_NOT_MODIFIED) || (r.type == "HEAD");
+    _bodyDone = _bodyDone || _bodyRead;
+    if (r.cb) {
+        r.cb(r.id, code);
+    }
+    if (!_bodyRead && connected()) {
+        if ((_transferEncoding == HTTPC_TE_IDENTITY) && (_size < 0)) {
+            _canReuse = false; // Body runs until the server closes, nothing can follow it
+        } else {
+            NullPrint discard;
+            writeToPrint(&discard);
+        }
+    }
+    _pipelining = false;
+    if ((code < 0) || !_bodyDone) {
+        _canReuse = false; // Can't tell where the next response starts
+    }
+    if (!_canReuse) {
+        if (_queueSent && _serverClose && (code > 0) && _bodyDone) {
+            // A server answering "Connection: close" doesn't process the requests behind that
+            // response, so they can be sent again on a new connection
+            DEBUG_HTTPCLIENT("[HTTP-Client][pipeline] resending %zu requests on a new connection\n", _queueSent);
+            _queueSent = 0;
+            if (connected()) {
+                _client()->stop();
+            }
+        } else if (_queueSent) {
+            pipelineFail(HTTPC_ERROR_CONNECTION_LOST);
+        } else if (connected()) {
+            _client()->stop();
+        }
+    }
+}
+
+/**
+    send all queued requests and wait for their responses
+    @return number of requests which received an HTTP response
+*/
+int HTTPClient::processQueue() {
+    int answered = 0;
+    while (!_queue.empty()) {
+        if (!pipelineSend()) {
+            continue;
+        }
+        beginResponse();
+        HeaderParser parser(*this);
+        int err = RunParser(_client(), parser, _tcpTimeout);
+        if (err) {
+            pipelineFail(err);
+            continue;
+        }
+        int code = endResponse(parser);
+        if (code > 0) {
+            answered++;
+        }
+        pipelineFinish(code);
+    }
+    return answered;
+}
+
+/**
+    advance the queued requests without waiting for response headers, which are parsed as
+    they trickle in.  This is not fully non-blocking: opening the connection, sending requests
+    and reading or skipping a body after its header has arrived all block, each for up to
+    the TCP timeout.
+    @return true while requests are outstanding
+*/
+bool HTTPClient::pollQueue() {
+    if (_queue.empty()) {
+        return false;
+    }
+    if (!_queueParser && !pipelineSend()) {
+        return !_queue.empty();
+    }
+    if (!_queueParser) {
+        beginResponse();
+        _queueParser.reset(new HeaderParser(*this));
+    }
+    if (FeedParser(_client(), *_queueParser)) {
+        _queueLastData = millis();
+    }
+    if (!_queueParser->done()) {
+        if (!_client()->connected()) {
+            pipelineFail(HTTPC_ERROR_CONNECTION_LOST);
+        } else if (millis() - _queueLastData > _tcpTimeout) {
+            pipelineFail(HTTPC_ERROR_READ_TIMEOUT);
+        }
+        return !_queue.empty();
+    }
+    int code = endResponse(*_queueParser);
+    _queueParser.reset();
+    pipelineFinish(code);
+    return !_queue.empty();
 }
 
 /**
@@ -769,6 +1411,13 @@ int HTTPClient::writeToPrint(Print * print) {
         return returnError(HTTPC_ERROR_NO_STREAM);
     }
 
+    if (_pipelining) {
+        if (_bodyRead) {
+            return 0; // Already consumed or there is no body, don't eat the next response
+        }
+        _bodyRead = true;
+    }
+
     // Only return error if not connected and no data available, because otherwise ::getString() will return an error instead of an empty
     // string when the server returned a http code 204 (no content)
     if (!connected() && _transferEncoding != HTTPC_TE_IDENTITY && _size > 0) {
@@ -778,15 +1427,17 @@ int HTTPClient::writeToPrint(Print * print) {
     // get length of document (is -1 when Server sends no Content-Length header)
     int len = _size;
     int ret = 0;
+    _bodyProgress = 0;
 
     if (_transferEncoding == HTTPC_TE_IDENTITY) {
         // len < 0: transfer all of it, with timeout
         // len >= 0: max:len, with timeout
-        ret = StreamSendSize(_client(), print, len);
+        ret = receiveBody(print, len);
 
         if (len > 0 && ret != len) {
             return HTTPC_ERROR_NO_STREAM;
         }
+        _bodyDone = (len >= 0);
         // do we have an error?
         //        if(_client->getLastSendReport() != Stream::Report::Success) {
         //            return returnError(StreamReportToHttpClientReport(_client->getLastSendReport()));
@@ -797,24 +1448,24 @@ int HTTPClient::writeToPrint(Print * print) {
             if (!connected()) {
                 return returnError(HTTPC_ERROR_CONNECTION_LOST);
             }
-            String chunkHeader = _client()->readStringUntil('\n');
-
-            if (chunkHeader.length() <= 0) {
-                return returnError(HTTPC_ERROR_READ_TIMEOUT);
+            ChunkParser chunk;
+            int err = RunParser(_client(), chunk, _tcpTimeout);
+            if (err) {
+                return returnError(err);
+            }
+            if (!chunk.valid()) {
+                return returnError(HTTPC_ERROR_ENCODING);
             }
-
-            chunkHeader.trim(); // remove \r
-            DEBUG_HTTPCLIENT("[HTTP-Client] chunk header: '%s'\n", chunkHeader.c_str());
 
             // read size of chunk
-            len = (uint32_t) strtol((const char *) chunkHeader.c_str(), nullptr, 16);
+            len = chunk.size();
             size += len;
             DEBUG_HTTPCLIENT("[HTTP-Client] read chunk len: %d\n", len);
 
             // data left?
             if (len > 0) {
                 // read len bytes with timeout
-                int r = StreamSendSize(_client(), print, len);
+                int r = receiveBody(print, len);
                 if (r != len) {
                     return HTTPC_ERROR_NO_STREAM;
                 }
@@ -834,6 +1485,14 @@ int HTTPClient::writeToPrint(Print * print) {
                 if (ret != _size) {
                     return returnError(HTTPC_ERROR_STREAM_WRITE);
                 }
+
+                // skip any trailer fields up to the empty line ending the body
+                TrailerParser trailer;
+                err = RunParser(_client(), trailer, _tcpTimeout);
+                if (err) {
+                    return returnError(err);
+                }
+                _bodyDone = true;
                 break;
             }
 
@@ -852,6 +1511,118 @@ int HTTPClient::writeToPrint(Print * print) {
     return ret;
 }
 
+/**
+    set a callback reporting body progress during writeToPrint/writeToStream
+    @param fn called with (bytes written, total size or 0 if unknown)
+*/
+void HTTPClient::onProgress(THandlerFunction_Progress fn) {
+    _progressCB = std::move(fn);
+}
+
+/**
+    send size bytes of a request body read from a Stream, in HTTP_TCP_BUFFER_SIZE blocks
+    @param src Stream
+    @param size size_t
+    @return bytes sent, short if src or the connection stalled for more than the TCP timeout
+*/
+size_t HTTPClient::sendBody(Stream *src, size_t size) {
+    if (!size) {
+        return 0;
+    }
+    size_t bufLen = std::min(size, (size_t)HTTP_TCP_BUFFER_SIZE);
+    std::unique_ptr<uint8_t[]> buf(new (std::nothrow) uint8_t[bufLen]);
+    if (!buf) {
+        DEBUG_HTTPCLIENT("[HTTP-Client][sendBody] not enough ram for %zu byte buffer\n", bufLen);
+        return 0;
+    }
+    size_t sent = 0;
+    uint32_t lastProgress = millis();
+    while (sent < size) {
+        int avail = src->available();
+        if (avail <= 0) {
+            if (millis() - lastProgress >= _tcpTimeout) {
+                break;
+            }
+            yield();
+            continue;
+        }
+        size_t len = std::min(std::min((size_t)avail, size - sent), bufLen);
+        len = src->readBytes(buf.get(), len);
+        if (!len) {
+            break;
+        }
+        size_t wrote = WriteBlock(_client(), buf.get(), len, _tcpTimeout);
+        sent += wrote;
+        if (wrote != len) {
+            break;
+        }
+        lastProgress = millis();
+    }
+    return sent;
+}
+
+/**
+    move response body bytes from the connection to a Print a whole received segment at a time.
+    When the client exposes the peek buffer API data goes straight from the network (or TLS)
+    receive buffer to the destination without an intermediate copy.
+    @param dst Print
+    @param size int bytes to move, or < 0 to move everything until the server closes
+    @return bytes moved, short if the connection closed or stalled for more than the TCP timeout
+*/
+size_t HTTPClient::receiveBody(Print *dst, int size) {
+    WiFiClient *src = _client();
+    if (!src) {
+        return 0;
+    }
+    const size_t want = (size < 0) ? SIZE_MAX : (size_t)size;
+    const size_t total = (_size > 0) ? _size : 0;
+    const bool peekable = src->hasPeekBufferAPI();
+    std::unique_ptr<uint8_t[]> buf;
+    size_t done = 0;
+    uint32_t lastProgress = millis();
+    while (done < want) {
+        size_t avail = peekable ? src->peekAvailable() : (size_t)std::max(src->available(), 0);
+        if (!avail) {
+            if (!src->connected() || (millis() - lastProgress >= _tcpTimeout)) {
+                break;
+            }
+            yield();
+            continue;
+        }
+        size_t len = std::min(avail, want - done);
+        size_t wrote;
+        if (peekable) {
+            wrote = WriteBlock(dst, (const uint8_t *)src->peekBuffer(), len, _tcpTimeout);
+            src->peekConsume(wrote);
+        } else {
+            if (!buf) {
+                buf.reset(new (std::nothrow) uint8_t[HTTP_TCP_BUFFER_SIZE]);
+                if (!buf) {
+                    DEBUG_HTTPCLIENT("[HTTP-Client][receiveBody] not enough ram for transfer buffer\n");
+                    break;
+                }
+            }
+            int r = src->read(buf.get(), std::min(len, (size_t)HTTP_TCP_BUFFER_SIZE));
+            if (r <= 0) {
+                break;
+            }
+            len = r;
+            wrote = WriteBlock(dst, buf.get(), len, _tcpTimeout);
+        }
+        done += wrote;
+        _bodyProgress += wrote;
+        if (_progressCB) {
+            _progressCB(_bodyProgress, total);
+        }
+        if (wrote != len) {
+            DEBUG_HTTPCLIENT("[HTTP-Client][receiveBody] short write, %zu of %zu\n", wrote, len);
+            break;
+        }
+        lastProgress = millis();
+    }
+    return done;
+}
+
 /**
     return all payload as String (may need lot of ram or trigger out of memory!)
     @return String
@@ -1008,6 +1779,22 @@ bool HTTPClient::connect(void) {
         return false;
     }
 
+    if (_pool && !_clientGiven) {
+        // A pooled TLS client brings its own trust settings, so they must match ours exactly
+        uint8_t auth[32];
+        if (_clientTLS) {
+            _tls()->getAuthSettingsHash(auth);
+        }
+        WiFiClient *pooled = _pool->acquire(_host, _port, _clientTLS, _poolTag, _clientTLS ? auth : nullptr);
+        if (pooled) {
+            DEBUG_HTTPCLIENT("[HTTP-Client] connect: reusing pooled connection to %s:%u\n", _host.c_str(), _port);
+            delete _clientMade;
+            _clientMade = pooled;
+            _client()->setTimeout(_tcpTimeout);
+            return true;
+        }
+    }
+
     _client()->setTimeout(_tcpTimeout);
 
     if (!_client()->connect(_host.c_str(), _port)) {
@@ -1079,7 +1866,7 @@ bool HTTPClient::sendHeader(const char * type) {
     DEBUG_HTTPCLIENT("[HTTP-Client] sending request header\n-----\n%s-----\n", header.c_str());
 
     // transfer all of it, with timeout
-    return StreamConstPtr(header).sendAll(_client()) == header.length();
+    return StreamConstPtr(header).sendAll(_client(), _tcpTimeout) == header.length();
 }
 
 /**
@@ -1092,107 +1879,63 @@ int HTTPClient::handleHeaderResponse() {
         return HTTPC_ERROR_NOT_CONNECTED;
     }
 
+    beginResponse();
+
+    HeaderParser parser(*this);
+    int err = RunParser(_client(), parser, _tcpTimeout);
+    if (err) {
+        return err;
+    }
+    return endResponse(parser);
+}
+
+/**
+    reset the response state before parsing a new response
+*/
+void HTTPClient::beginResponse() {
     clear();
 
     _canReuse = _reuse;
-
-    String transferEncoding;
+    _bodyDone = false;
+    _serverClose = false;
 
     _transferEncoding = HTTPC_TE_IDENTITY;
-    unsigned long lastDataTime = millis();
-
-    while (connected()) {
-        size_t len = _client()->available();
-        if (len > 0) {
-            int headerSeparator = -1;
-            String headerLine = _client()->readStringUntil('\n');
-
-            lastDataTime = millis();
-
-            DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] RX: '%s'\n", headerLine.c_str());
-
-            if (headerLine.startsWith(F("HTTP/1."))) {
-
-                constexpr auto httpVersionIdx = sizeof "HTTP/1." - 1;
-                _canReuse = _canReuse && (headerLine[httpVersionIdx] != '0');
-                _returnCode = headerLine.substring(httpVersionIdx + 2, headerLine.indexOf(' ', httpVersionIdx + 2)).toInt();
-                _canReuse = _canReuse && (_returnCode > 0) && (_returnCode < 500);
-
-            } else if ((headerSeparator = headerLine.indexOf(':')) > 0) {
-                String headerName = headerLine.substring(0, headerSeparator);
-                String headerValue = headerLine.substring(headerSeparator + 1);
-                headerValue.trim();
-
-                if (headerName.equalsIgnoreCase(F("Content-Length"))) {
-                    _size = headerValue.toInt();
-                }
-
-                if (_canReuse && headerName.equalsIgnoreCase(F("Connection"))) {
-                    if (headerValue.indexOf(F("close")) >= 0 &&
-                            headerValue.indexOf(F("keep-alive")) < 0) {
-                        _canReuse = false;
-                    }
-                }
-
-                if (headerName.equalsIgnoreCase(F("Transfer-Encoding"))) {
-                    transferEncoding = headerValue;
-                }
-
-                if (headerName.equalsIgnoreCase(F("Location"))) {
-                    _location = headerValue;
-                }
-
-                for (size_t i = 0; i < _headerKeysCount; i++) {
-                    if (_currentHeaders[i].key.equalsIgnoreCase(headerName)) {
-                        if (_currentHeaders[i].value != "") {
-                            // Existing value, append this one with a comma
-                            _currentHeaders[i].value += ',';
-                            _currentHeaders[i].value += headerValue;
-                        } else {
-                            _currentHeaders[i].value = headerValue;
-                        }
-                        break; // We found a match, stop looking
-                    }
-                }
-                continue;
-            }
-
-            headerLine.trim(); // remove \r
+}
 
-            if (headerLine == "") {
-                DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] code: %d\n", _returnCode);
+/**
+    apply a completely parsed response header
+    @return int http code
+*/
+int HTTPClient::endResponse(HeaderParser &parser) {
+    DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] code: %d\n", _returnCode);
 
-                if (_size > 0) {
-                    DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] size: %d\n", _size);
-                }
+    if (_size > 0) {
+        DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] size: %d\n", _size);
+    }
 
-                if (transferEncoding.length() > 0) {
-                    DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] Transfer-Encoding: %s\n", transferEncoding.c_str());
-                    if (transferEncoding.equalsIgnoreCase(F("chunked"))) {
-                        _transferEncoding = HTTPC_TE_CHUNKED;
-                    } else {
-                        _returnCode = HTTPC_ERROR_ENCODING;
-                        return _returnCode;
-                    }
-                } else {
-                    _transferEncoding = HTTPC_TE_IDENTITY;
-                }
+    switch (parser.transferEncoding()) {
+    case HeaderParser::TE_CHUNKED:
+        DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] Transfer-Encoding: chunked\n");
+        _transferEncoding = HTTPC_TE_CHUNKED;
+        break;
+    case HeaderParser::TE_OTHER:
+        DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] unsupported Transfer-Encoding\n");
+        _returnCode = HTTPC_ERROR_ENCODING;
+        return _returnCode;
+    default:
+        _transferEncoding = HTTPC_TE_IDENTITY;
+        break;
+    }
 
-                if (_returnCode <= 0) {
-                    DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] Remote host is not an HTTP Server!");
-                    _returnCode = HTTPC_ERROR_NO_HTTP_SERVER;
-                }
-                return _returnCode;
-            }
+    // 1xx, 204 and 304 responses never have a body, and neither does an empty identity one
+    _bodyDone = ((_returnCode >= 100) && (_returnCode < 200)) || (_returnCode == HTTP_CODE_NO_CONTENT) ||
+                (_returnCode == HTTP_CODE_NOT_MODIFIED) || ((_transferEncoding == HTTPC_TE_IDENTITY) && !_size);
 
-        } else {
-            if ((millis() - lastDataTime) > _tcpTimeout) {
-                return HTTPC_ERROR_READ_TIMEOUT;
-            }
-        }
+    if (_returnCode <= 0) {
+        DEBUG_HTTPCLIENT("[HTTP-Client][handleHeaderResponse] Remote host is not an HTTP Server!");
+        _returnCode = HTTPC_ERROR_NO_HTTP_SERVER;
     }
-
-    return HTTPC_ERROR_CONNECTION_LOST;
+    return _returnCode;
 }
 
 /**
@@ -31,7 +31,10 @@
 #include <StreamString.h>
 #include <WiFiClient.h>
 #include <WiFiClientSecure.h>
+#include "HTTPConnectionPool.h"
 
+#include <deque>
+#include <functional>
 #include <memory>
 
 #ifdef DEBUG_ESP_HTTP_CLIENT
@@ -155,10 +158,13 @@ typedef std::unique_ptr<TransportTraits> TransportTraitsPtr;
 
 class HTTPClient {
 public:
-    HTTPClient() = default;
-    ~HTTPClient() = default;
-    HTTPClient(HTTPClient&&) = default;
-    HTTPClient& operator=(HTTPClient&&) = default;
+    typedef std::function<void(size_t, size_t)> THandlerFunction_Progress;
+    typedef std::function<void(int, int)> THandlerFunction_Response;
+
+    HTTPClient();
+    ~HTTPClient();
+    HTTPClient(HTTPClient&&);
+    HTTPClient& operator=(HTTPClient&&);
 
     // The easier way
     bool begin(String url);
@@ -182,6 +188,9 @@ public:
     bool connected(void);
 
     void setReuse(bool reuse); /// keep-alive
+    // Share keep-alive connections with other HTTPClients through a pool, nullptr to disable.
+    // HTTPS connections are only shared between clients with identical TLS settings.
+    void setConnectionPool(HTTPConnectionPool *pool = &HTTPPool, uint32_t tlsTag = 0);
     void setUserAgent(const String& userAgent);
     void setAuthorization(const char * user, const char * password);
     void setAuthorization(const char * auth);
@@ -208,6 +217,34 @@ public:
     int sendRequest(const char* type, const uint8_t* payload = nullptr, size_t size = 0);
     int sendRequest(const char* type, Stream * stream, size_t size = 0);
 
+    /// pipelined request handling
+    // Queued requests are sent back to back on one keep-alive connection and their responses
+    // are reported in order to each callback as (request id, http code or HTTPC_ERROR_*).
+    // Inside the callback header(), getSize(), getString(), etc. refer to that response, and
+    // any body the callback doesn't read is discarded.  Headers added with addHeader() apply
+    // to the next queued request.  The returned id is the request's handle: there is no
+    // future object, completion is only reported through the callback, and isQueued(id)
+    // tells whether it is still waiting.
+    int queueRequest(const char* type, const String& uri, const uint8_t* payload, size_t size, THandlerFunction_Response cb);
+    int queueRequest(const char* type, const String& uri, const String& payload, THandlerFunction_Response cb);
+    int queueRequest(const char* type, const String& uri, THandlerFunction_Response cb) {
+        return queueRequest(type, uri, nullptr, 0, cb);
+    }
+    void setPipelineDepth(uint8_t depth); // max requests awaiting a response, default 4
+    int processQueue(); // blocking, returns number of requests which got an HTTP response
+    bool pollQueue(); // doesn't wait for response headers (connect, send and bodies still block), call from loop() while it returns true
+    size_t queued() const {
+        return _queue.size();
+    }
+    bool isQueued(int id) const {
+        for (const auto &r : _queue) {
+            if (r.id == id) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
 
     /// Response handling
@@ -226,6 +263,8 @@ public:
     WiFiClient* getStreamPtr(void);
     int writeToPrint(Print* print);
     int writeToStream(Stream* stream);
+    // Called as the body is written by writeToPrint/writeToStream with (bytes done, total), total=0 if unknown
+    void onProgress(THandlerFunction_Progress fn);
     const String& getString(void);
     static String errorToString(int error);
 
@@ -236,6 +275,9 @@ public:
     void setSession(Session *session) {
         _tls()->setSession(session);
     }
+    void setSessionCache(ClientSessionCache *cache) {
+        _tls()->setSessionCache(cache);
+    }
     void setInsecure() {
         _tls()->setInsecure();
     }
@@ -318,14 +360,23 @@ protected:
         String value;
     };
 
+    // Incremental response parsers, see HTTPClient.cpp
+    class HeaderParser;
+    class ChunkParser;
+    class TrailerParser;
+
     bool beginInternal(const String& url, const char* expectedProtocol);
     void disconnect(bool preserveClient = false);
     void clear();
     int returnError(int error);
     bool connect(void);
     bool sendHeader(const char * type);
+    void beginResponse();
+    int endResponse(HeaderParser &parser);
     int handleHeaderResponse();
     int writeToStreamDataBlock(Stream * stream, int len);
+    size_t sendBody(Stream *src, size_t size);
+    size_t receiveBody(Print *dst, int size);
 
     WiFiClient *_clientMade = nullptr;
     bool _clientTLS = false;
@@ -345,6 +396,8 @@ protected:
     String _host;
     uint16_t _port = 0;
     bool _reuse = true;
+    HTTPConnectionPool *_pool = nullptr;
+    uint32_t _poolTag = 0;
     uint16_t _tcpTimeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
     bool _useHTTP10 = false;
 
@@ -363,11 +416,38 @@ protected:
     int _returnCode = 0;
     int _size = -1;
     bool _canReuse = false;
+    bool _bodyDone = false; // The whole response body has been read off the connection
+    bool _serverClose = false; // The response carried "Connection: close"
     followRedirects_t _followRedirects = HTTPC_DISABLE_FOLLOW_REDIRECTS;
     uint16_t _redirectLimit = 10;
     String _location;
     transferEncoding_t _transferEncoding = HTTPC_TE_IDENTITY;
     std::unique_ptr<StreamString> _payload;
+    THandlerFunction_Progress _progressCB = nullptr;
+    size_t _bodyProgress = 0;
+
+    /// pipelined request handling
+    struct QueuedRequest {
+        int id;
+        String type;
+        String uri;
+        String headers;
+        std::unique_ptr<uint8_t[]> payload;
+        size_t size;
+        THandlerFunction_Response cb;
+    };
+    bool pipelineSend();
+    void pipelineFail(int error);
+    void pipelineFinish(int code);
+
+    std::deque<QueuedRequest> _queue;
+    size_t _queueSent = 0; // Leading _queue entries awaiting a response
+    uint8_t _pipelineDepth = 4;
+    int _nextRequestId = 0;
+    bool _pipelining = false;
+    bool _bodyRead = false;
+    uint32_t _queueLastData = 0;
+    std::unique_ptr<HeaderParser> _queueParser;
 
 
 };
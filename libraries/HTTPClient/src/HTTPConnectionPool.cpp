@@ -0,0 +1,123 @@
+/*
+    HTTPConnectionPool.cpp - Shares idle keep-alive connections between HTTPClients
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "HTTPConnectionPool.h"
+
+HTTPConnectionPool::HTTPConnectionPool(size_t maxIdle, uint32_t idleTimeout) {
+    _maxIdle = maxIdle;
+    _idleTimeout = idleTimeout;
+}
+
+HTTPConnectionPool::~HTTPConnectionPool() {
+    clear();
+}
+
+void HTTPConnectionPool::setMaxIdle(size_t maxIdle) {
+    _maxIdle = maxIdle;
+    while (_idle.size() > _maxIdle) {
+        _idle.front().client->stop();
+        _idle.erase(_idle.begin());
+        _stats.overflow++;
+    }
+}
+
+void HTTPConnectionPool::setIdleTimeout(uint32_t ms) {
+    _idleTimeout = ms;
+    prune();
+}
+
+// A pooled connection is only usable if the server hasn't closed it and hasn't sent anything
+// since the last response (which would be an error or close notification we can't interpret)
+bool HTTPConnectionPool::healthy(Entry &e) {
+    if (millis() - e.since > _idleTimeout) {
+        _stats.expired++;
+        return false;
+    }
+    if (!e.client->connected() || (e.client->available() > 0)) {
+        _stats.stale++;
+        return false;
+    }
+    return true;
+}
+
+void HTTPConnectionPool::prune() {
+    for (auto it = _idle.begin(); it != _idle.end();) {
+        if (healthy(*it)) {
+            ++it;
+        } else {
+            it->client->stop();
+            it = _idle.erase(it);
+        }
+    }
+}
+
+void HTTPConnectionPool::clear() {
+    for (auto &e : _idle) {
+        e.client->stop();
+    }
+    _idle.clear();
+}
+
+WiFiClient *HTTPConnectionPool::acquire(const String& host, uint16_t port, bool tls, uint32_t tag, const uint8_t *auth) {
+    static const uint8_t none[32] = {};
+    // Search newest first, it is the least likely to have been closed by the server
+    for (size_t i = _idle.size(); i > 0; i--) {
+        Entry &e = _idle[i - 1];
+        if ((e.port != port) || (e.tls != tls) || (e.tag != tag) || memcmp(e.auth, auth ? auth : none, sizeof(e.auth)) ||
+                !e.host.equalsIgnoreCase(host)) {
+            continue;
+        }
+        if (!healthy(e)) {
+            e.client->stop();
+            _idle.erase(_idle.begin() + (i - 1));
+            continue;
+        }
+        WiFiClient *c = e.client.release();
+        _idle.erase(_idle.begin() + (i - 1));
+        _stats.hits++;
+        return c;
+    }
+    _stats.misses++;
+    return nullptr;
+}
+
+bool HTTPConnectionPool::release(WiFiClient *client, const String& host, uint16_t port, bool tls, uint32_t tag, const uint8_t *auth) {
+    if (!client) {
+        return false;
+    }
+    if (!_maxIdle || !client->connected()) {
+        client->stop();
+        delete client;
+        return false;
+    }
+    prune();
+    while (_idle.size() >= _maxIdle) {
+        _idle.front().client->stop();
+        _idle.erase(_idle.begin());
+        _stats.overflow++;
+    }
+    Entry e = {host, port, tls, tag, {}, (uint32_t)millis(), std::unique_ptr<WiFiClient>(client)};
+    if (auth) {
+        memcpy(e.auth, auth, sizeof(e.auth));
+    }
+    _idle.push_back(std::move(e));
+    return true;
+}
+
+HTTPConnectionPool HTTPPool;
@@ -0,0 +1,94 @@
+/*
+    HTTPConnectionPool.h - Shares idle keep-alive connections between HTTPClients
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#include <memory>
+#include <vector>
+
+#define HTTPPOOL_DEFAULT_MAX_IDLE      (4)
+#define HTTPPOOL_DEFAULT_IDLE_TIMEOUT  (10000)
+
+// Holds connected, idle keep-alive clients handed back by HTTPClient::end() and lends them to
+// the next HTTPClient talking to the same scheme/host/port/tag, skipping the TCP and TLS
+// handshakes.  TLS clients keep the settings (trust anchors, insecure, etc.) they were
+// connected with, so they are also keyed by the hash of those settings from
+// WiFiClientSecure::getAuthSettingsHash() and only lent to clients configured identically.
+class HTTPConnectionPool {
+public:
+    struct Stats {
+        uint32_t hits;       // Connections lent out
+        uint32_t misses;     // Lookups with no usable idle connection
+        uint32_t stale;      // Evicted because they closed or had unexpected data pending
+        uint32_t expired;    // Evicted after being idle too long
+        uint32_t overflow;   // Evicted (oldest first) to stay under the idle limit
+    };
+
+    HTTPConnectionPool(size_t maxIdle = HTTPPOOL_DEFAULT_MAX_IDLE, uint32_t idleTimeout = HTTPPOOL_DEFAULT_IDLE_TIMEOUT);
+    ~HTTPConnectionPool();
+
+    // Maximum number of idle connections kept across all hosts, 0 disables pooling
+    void setMaxIdle(size_t maxIdle);
+    // Idle connections older than this many milliseconds are closed instead of reused
+    void setIdleTimeout(uint32_t ms);
+
+    // Returns an owned, connected client for the key or nullptr.  The caller must delete it.
+    // auth is the 32 byte TLS settings hash, or nullptr for plain connections.
+    WiFiClient *acquire(const String& host, uint16_t port, bool tls, uint32_t tag = 0, const uint8_t *auth = nullptr);
+    // Takes ownership of a client.  Returns false if it couldn't be pooled and was closed and deleted.
+    bool release(WiFiClient *client, const String& host, uint16_t port, bool tls, uint32_t tag = 0, const uint8_t *auth = nullptr);
+
+    // Closes idle connections which have expired or dropped
+    void prune();
+    // Closes every idle connection
+    void clear();
+
+    size_t idle() const {
+        return _idle.size();
+    }
+    const Stats &stats() const {
+        return _stats;
+    }
+    void resetStats() {
+        _stats = {};
+    }
+
+protected:
+    struct Entry {
+        String host;
+        uint16_t port;
+        bool tls;
+        uint32_t tag;
+        uint8_t auth[32];
+        uint32_t since;
+        std::unique_ptr<WiFiClient> client;
+    };
+
+    bool healthy(Entry &e);
+
+    std::vector<Entry> _idle; // Oldest first
+    size_t _maxIdle;
+    uint32_t _idleTimeout;
+    Stats _stats = {};
+};
+
+extern HTTPConnectionPool HTTPPool;
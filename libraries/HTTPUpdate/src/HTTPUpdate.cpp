@@ -145,6 +145,8 @@ String HTTPUpdate::getLastErrorString(void) {
         return F("New Binary Does Not Fit Flash Size");
     case HTTP_UE_SERVER_UNAUTHORIZED:
         return F("Unauthorized (401)");
+    case HTTP_UE_SERVER_RESUME_FAILED:
+        return F("Server Could Not Resume Download");
     }
 
     return String();
@@ -188,7 +190,7 @@ HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& curren
         http.setAuthorization(_auth.c_str());
     }
 
-    const char * headerkeys[] = { "x-MD5" };
+    const char * headerkeys[] = { "x-MD5", "ETag", "Content-Range" };
     size_t headerkeyssize = sizeof(headerkeys) / sizeof(char*);
 
     // track these headers
@@ -273,7 +275,16 @@ HTTPUpdateResult HTTPUpdate::handleUpdate(HTTPClient& http, const String& curren
                     DEBUG_HTTP_UPDATE("[httpUpdate] runUpdate flash...\n");
                 }
 
-                if (runUpdate(*tcp, len, md5, command)) {
+                // Only a strong ETag guarantees a later range of the same bytes
+                String etag = http.header("ETag");
+                bool ok;
+                if (_resumeAttempts && etag.length() && !etag.startsWith("W/")) {
+                    ok = runResumableUpdate(http, len, md5, command, etag);
+                } else {
+                    ok = runUpdate(*tcp, len, md5, command);
+                }
+
+                if (ok) {
                     ret = HTTP_UPDATE_OK;
                     DEBUG_HTTP_UPDATE("[httpUpdate] Update ok\n");
                     http.end();
@@ -340,10 +351,111 @@ bool HTTPUpdate::runUpdate(Stream& in, uint32_t size, const String& md5, int com
 
     StreamString error;
 
+    if (!beginUpdate(size, md5, command, emptyString)) {
+        return false;
+    }
+
+    if (Update.writeStream(in) != size) {
+        _setLastError(Update.getError());
+        Update.printError(error);
+        error.trim(); // remove line ending
+        DEBUG_HTTP_UPDATE("[httpUpdate] Update.writeStream failed! (%s)\n", error.c_str());
+        return false;
+    }
+
+    return endUpdate(size);
+}
+
+/**
+    write Update to flash from the response body, requesting whatever doesn't arrive (or
+    was already written before a reset) from the same image again with Range requests
+    @param http HTTPClient& holding the 200 response
+    @param size uint32_t
+    @param md5 String
+    @param etag String strong ETag of the image
+    @return true if Update ok
+*/
+bool HTTPUpdate::runResumableUpdate(HTTPClient& http, uint32_t size, const String& md5, int command, const String& etag) {
+
+    StreamString error;
+
+    if (!beginUpdate(size, md5, command, etag)) {
+        return false;
+    }
+
+    WiFiClient *tcp = http.getStreamPtr();
+    bool request = Update.progress() > 0; // Resuming from before a reset
+    uint8_t stalled = 0;
+    while (true) {
+        size_t at = Update.progress();
+        if (request) {
+            DEBUG_HTTP_UPDATE("[httpUpdate] Resuming at %zu\n", at);
+            if (tcp) {
+                tcp->stop();
+            }
+            http.addHeader(F("Range"), String(F("bytes=")) + String(at) + '-');
+            http.addHeader(F("If-Range"), etag);
+            int code = http.GET();
+            tcp = http.getStreamPtr();
+            bool ready = (code > 0) && tcp;
+            char want[48];
+            snprintf(want, sizeof(want), "bytes %zu-%lu/%lu", at, (unsigned long)size - 1, (unsigned long)size);
+            if (ready && (code == HTTP_CODE_OK) && (http.header("ETag") == etag) && (http.getSize() == (int)size)) {
+                // The same image from a server which ignores ranges, so skip what's written
+                uint8_t skip[128];
+                for (size_t left = at, n = 0; ready && left; left -= n) {
+                    n = tcp->readBytes(skip, std::min(left, sizeof(skip)));
+                    ready = (n > 0);
+                }
+            } else if ((code > 0) && ((code != HTTP_CODE_PARTIAL_CONTENT) || (http.header("Content-Range") != want))) {
+                // The image changed, starting again is left to the next update() call
+                DEBUG_HTTP_UPDATE("[httpUpdate] Range not satisfied: %d %s\n", code, http.header("Content-Range").c_str());
+                _setLastError(HTTP_UE_SERVER_RESUME_FAILED);
+                Update.end();
+                return false;
+            }
+            if (ready) {
+                Update.writeStream(*tcp, _httpClientTimeout);
+            }
+        } else {
+            Update.writeStream(*tcp, _httpClientTimeout);
+        }
+
+        if (!Update.isRunning()) {
+            _setLastError(Update.getError());
+            Update.printError(error);
+            error.trim(); // remove line ending
+            DEBUG_HTTP_UPDATE("[httpUpdate] Update.writeStream failed! (%s)\n", error.c_str());
+            return false;
+        }
+        if (Update.isFinished()) {
+            break;
+        }
+        stalled = (Update.progress() > at) ? 0 : stalled + 1;
+        if (stalled >= _resumeAttempts) {
+            DEBUG_HTTP_UPDATE("[httpUpdate] Giving up at %zu, will resume from there\n", Update.progress());
+            _setLastError(HTTPC_ERROR_CONNECTION_LOST);
+            Update.end();
+            return false;
+        }
+        request = true;
+    }
+
+    return endUpdate(size);
+}
+
+/**
+    start Update, resuming a checkpointed one of the same image when etag is set
+*/
+bool HTTPUpdate::beginUpdate(uint32_t size, const String& md5, int command, const String& etag) {
+
+    StreamString error;
+
     if (_cbProgress) {
         Update.onProgress(_cbProgress);
     }
 
+    Update.setResumeTag(etag);
     if (!Update.begin(size, command)) {
         _setLastError(Update.getError());
         Update.printError(error);
@@ -353,7 +465,7 @@ bool HTTPUpdate::runUpdate(Stream& in, uint32_t size, const String& md5, int com
     }
 
     if (_cbProgress) {
-        _cbProgress(0, size);
+        _cbProgress(Update.progress(), size);
     }
 
     if (md5.length()) {
@@ -363,14 +475,15 @@ bool HTTPUpdate::runUpdate(Stream& in, uint32_t size, const String& md5, int com
             return false;
         }
     }
+    return true;
+}
 
-    if (Update.writeStream(in) != size) {
-        _setLastError(Update.getError());
-        Update.printError(error);
-        error.trim(); // remove line ending
-        DEBUG_HTTP_UPDATE("[httpUpdate] Update.writeStream failed! (%s)\n", error.c_str());
-        return false;
-    }
+/**
+    check and commit the complete Update
+*/
+bool HTTPUpdate::endUpdate(uint32_t size) {
+
+    StreamString error;
 
     if (_cbProgress) {
         _cbProgress(size, size);
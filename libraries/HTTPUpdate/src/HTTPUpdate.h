@@ -52,6 +52,7 @@ constexpr int HTTP_UE_SERVER_FAULTY_MD5         = (-105);
 constexpr int HTTP_UE_BIN_VERIFY_HEADER_FAILED  = (-106);
 constexpr int HTTP_UE_BIN_FOR_WRONG_FLASH       = (-107);
 constexpr int HTTP_UE_SERVER_UNAUTHORIZED       = (-108);
+constexpr int HTTP_UE_SERVER_RESUME_FAILED      = (-109);
 
 enum HTTPUpdateResult {
     HTTP_UPDATE_FAILED,
@@ -100,6 +101,16 @@ public:
         _md5Sum = md5Sum;
     }
 
+    /**
+        continue a download which stops part way with Range requests, until this many
+        attempts in a row make no progress (0 disables).  Needs a strong ETag from the
+        server.  Sketch updates also resume after a reset, on the next update() call.
+        @param attempts
+    */
+    void setResumeAttempts(uint8_t attempts) {
+        _resumeAttempts = attempts;
+    }
+
     void setAuthorization(const String& user, const String& password);
     void setAuthorization(const String& auth);
 
@@ -132,6 +143,9 @@ public:
 protected:
     t_httpUpdate_return handleUpdate(HTTPClient& http, const String& currentVersion, bool spiffs = false);
     bool runUpdate(Stream& in, uint32_t size, const String& md5, int command = U_FLASH);
+    bool runResumableUpdate(HTTPClient& http, uint32_t size, const String& md5, int command, const String& etag);
+    bool beginUpdate(uint32_t size, const String& md5, int command, const String& etag);
+    bool endUpdate(uint32_t size);
 
     // Set the error and potentially use a CB to notify the application
     void _setLastError(int err) {
@@ -149,6 +163,7 @@ protected:
     String _md5Sum;
 private:
     int _httpClientTimeout;
+    uint8_t _resumeAttempts = 3;
     followRedirects_t _followRedirects = HTTPC_DISABLE_FOLLOW_REDIRECTS;
 
     // Callbacks
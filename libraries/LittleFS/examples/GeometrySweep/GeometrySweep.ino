@@ -0,0 +1,117 @@
+// Compares LittleFS geometry settings on a large-file and a many-small-files workload
+// Released to the public domain
+//
+// WARNING:  The filesystem will be formatted for each profile!
+
+#include <FS.h>
+#include <LittleFS.h>
+
+// How large of a file to test
+#define TESTSIZEKB 256
+
+// How many small files to test
+#define SMALLFILES 100
+
+typedef struct {
+  const char *name;
+  uint32_t readSize;
+  uint32_t progSize;
+  uint32_t cacheSize;
+  uint32_t lookaheadSize;
+  int32_t blockCycles;
+} Profile;
+
+const Profile profiles[] = {
+  { "Default", 256, 256, 256, 256, 16 },
+  { "Large files", 256, 1024, 4096, 256, 500 },
+  { "Small files", 64, 256, 256, 64, 500 },
+  { "Low RAM", 32, 256, 256, 16, 500 },
+};
+
+float kbps(unsigned long ms, unsigned long bytes) {
+  return ms ? (float)bytes / (float)ms : 0.0;
+}
+
+void DoTest(const Profile &p) {
+  LittleFS.end();
+  LittleFSConfig cfg;
+  cfg.setReadSize(p.readSize);
+  cfg.setProgSize(p.progSize);
+  cfg.setCacheSize(p.cacheSize);
+  cfg.setLookaheadSize(p.lookaheadSize);
+  cfg.setBlockCycles(p.blockCycles);
+  LittleFS.setConfig(cfg);
+  if (!LittleFS.format() || !LittleFS.begin()) {
+    Serial.printf("%s: unable to format/begin, skipping\n", p.name);
+    return;
+  }
+
+  uint8_t data[256];
+  for (int i = 0; i < 256; i++) {
+    data[i] = (uint8_t) i;
+  }
+
+  unsigned long start = millis();
+  File f = LittleFS.open("/big.bin", "w");
+  for (int i = 0; i < TESTSIZEKB * 4; i++) {
+    f.write(data, 256);
+  }
+  f.close();
+  unsigned long writeBig = millis() - start;
+
+  start = millis();
+  f = LittleFS.open("/big.bin", "r");
+  for (int i = 0; i < TESTSIZEKB * 4; i++) {
+    f.read(data, 256);
+  }
+  f.close();
+  unsigned long readBig = millis() - start;
+  LittleFS.remove("/big.bin");
+
+  char name[32];
+  start = millis();
+  for (int i = 0; i < SMALLFILES; i++) {
+    sprintf(name, "/small/%d.txt", i);
+    f = LittleFS.open(name, "w");
+    f.write(data, 64);
+    f.close();
+  }
+  unsigned long writeSmall = millis() - start;
+
+  start = millis();
+  for (int i = 0; i < SMALLFILES; i++) {
+    sprintf(name, "/small/%d.txt", i);
+    f = LittleFS.open(name, "r");
+    f.read(data, 64);
+    f.close();
+  }
+  unsigned long readSmall = millis() - start;
+
+  FSInfo info;
+  LittleFS.info(info);
+
+  start = millis();
+  for (int i = 0; i < SMALLFILES; i++) {
+    sprintf(name, "/small/%d.txt", i);
+    LittleFS.remove(name);
+  }
+  unsigned long removeSmall = millis() - start;
+
+  Serial.printf("%-12s big write %7.1f KB/s, read %7.1f KB/s | %d small: write %5lu ms, read %5lu ms, remove %5lu ms, %6u bytes used\n",
+                p.name, kbps(writeBig, TESTSIZEKB * 1024), kbps(readBig, TESTSIZEKB * 1024),
+                SMALLFILES, writeSmall, readSmall, removeSmall, (unsigned)info.usedBytes);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(5000);
+  Serial.printf("Beginning sweep\n");
+  for (auto &p : profiles) {
+    DoTest(p);
+  }
+  Serial.println("done");
+}
+
+void loop() {
+  delay(10000);
+}
@@ -173,6 +173,11 @@ DirImplPtr LittleFSImpl::openDir(const char *path) {
 int LittleFSImpl::lfs_flash_read(const struct lfs_config *c,
                                  lfs_block_t block, lfs_off_t off, void *dst, lfs_size_t size) {
     LittleFSImpl *me = reinterpret_cast<LittleFSImpl*>(c->context);
+    WBBlock *b = me->_wbFind(block);
+    if (b) {
+        memcpy(dst, b->data + off, size);
+        return 0;
+    }
     //    Serial.printf(" READ: %p, %d\n", me->_start + (block * me->_blockSize) + off, size);
     memcpy(dst, me->_start + (block * me->_blockSize) + off, size);
     return 0;
@@ -181,6 +186,20 @@ int LittleFSImpl::lfs_flash_read(const struct lfs_config *c,
 int LittleFSImpl::lfs_flash_prog(const struct lfs_config *c,
                                  lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
     LittleFSImpl *me = reinterpret_cast<LittleFSImpl*>(c->context);
+    if (me->_wb) {
+        WBBlock *b = me->_wbGet(block, true);
+        const uint8_t *src = (const uint8_t *)buffer;
+        for (lfs_size_t i = 0; i < size; i++) {
+            b->data[off + i] &= src[i];
+        }
+        for (lfs_off_t p = off / me->_pageSize; p < (off + size + me->_pageSize - 1) / me->_pageSize; p++) {
+            if (!b->queued[p]) {
+                b->queued[p] = 1;
+                me->_wbOps[me->_wbOpCount++] = { (uint8_t)(b - me->_wb), (int16_t)p };
+            }
+        }
+        return 0;
+    }
     uint8_t *addr = me->_start + (block * me->_blockSize) + off;
     noInterrupts();
     rp2040.idleOtherCore();
@@ -193,6 +212,22 @@ int LittleFSImpl::lfs_flash_prog(const struct lfs_config *c,
 
 int LittleFSImpl::lfs_flash_erase(const struct lfs_config *c, lfs_block_t block) {
     LittleFSImpl *me = reinterpret_cast<LittleFSImpl*>(c->context);
+    if (me->_wb) {
+        WBBlock *b = me->_wbGet(block, false);
+        uint8_t entry = b - me->_wb;
+        // Anything queued for the block before is wiped out by the erase
+        size_t n = 0;
+        for (size_t i = 0; i < me->_wbOpCount; i++) {
+            if (me->_wbOps[i].entry != entry) {
+                me->_wbOps[n++] = me->_wbOps[i];
+            }
+        }
+        me->_wbOps[n++] = { entry, -1 };
+        me->_wbOpCount = n;
+        memset(b->data, 0xff, me->_blockSize);
+        memset(b->queued, 0, me->_blockSize / me->_pageSize);
+        return 0;
+    }
     uint8_t *addr = me->_start + (block * me->_blockSize);
     //    Serial.printf("ERASE: %p, %d\n", (intptr_t)addr - (intptr_t)XIP_BASE, me->_blockSize);
     noInterrupts();
@@ -204,11 +239,150 @@ int LittleFSImpl::lfs_flash_erase(const struct lfs_config *c, lfs_block_t block)
 }
 
 int LittleFSImpl::lfs_flash_sync(const struct lfs_config *c) {
-    /* NOOP */
-    (void) c;
+    LittleFSImpl *me = reinterpret_cast<LittleFSImpl*>(c->context);
+    me->_wbFlush();
     return 0;
 }
 
+// Checks the LittleFSConfig geometry and sets littlefs up to use it, with its buffers
+// allocated here once instead of by littlefs on every mount
+bool LittleFSImpl::_applyConfig() {
+    uint32_t read = _cfg._readSize;
+    uint32_t prog = _cfg._progSize;
+    uint32_t cache = _cfg._cacheSize;
+    uint32_t lookahead = _cfg._lookaheadSize;
+    if (!read || !prog || !cache || (cache % read) || (cache % prog) || (prog % _pageSize) || (_blockSize % cache) ||
+            !lookahead || (lookahead % 8) || !_cfg._blockCycles) {
+        DEBUGV("LittleFS: invalid geometry read=%u prog=%u cache=%u lookahead=%u cycles=%d\n", read, prog, cache, lookahead, _cfg._blockCycles);
+        return false;
+    }
+    if (_readBuffer && ((_lfs_cfg.cache_size != cache) || (_lfs_cfg.lookahead_size != lookahead))) {
+        _freeBuffers();
+    }
+    if (!_readBuffer) {
+        _readBuffer = new uint8_t[cache];
+        _progBuffer = new uint8_t[cache];
+        _lookaheadBuffer = new uint8_t[lookahead];
+    }
+    _lfs_cfg.read_size = read;
+    _lfs_cfg.prog_size = prog;
+    _lfs_cfg.cache_size = cache;
+    _lfs_cfg.lookahead_size = lookahead;
+    _lfs_cfg.block_cycles = _cfg._blockCycles;
+    _lfs_cfg.read_buffer = _readBuffer;
+    _lfs_cfg.prog_buffer = _progBuffer;
+    _lfs_cfg.lookahead_buffer = _lookaheadBuffer;
+    return true;
+}
+
+void LittleFSImpl::_freeBuffers() {
+    delete[] _readBuffer;
+    delete[] _progBuffer;
+    delete[] _lookaheadBuffer;
+    _readBuffer = nullptr;
+    _progBuffer = nullptr;
+    _lookaheadBuffer = nullptr;
+    _lfs_cfg.read_buffer = nullptr;
+    _lfs_cfg.prog_buffer = nullptr;
+    _lfs_cfg.lookahead_buffer = nullptr;
+}
+
+// Write-behind: progs and erases are applied to a RAM copy of each block they touch, and the
+// order they came in is kept.  littlefs only relies on them being on flash once it syncs, so
+// then (or when every block buffer is in use) they're replayed to flash in the same order,
+// passing through the same states littlefs would otherwise have left at a reset, with the
+// other core idled once for the lot (or once per erase, which take ~45ms each).  Runs of
+// pages are programmed in one call, and interrupts are only held off during each flash
+// operation, as before.
+void LittleFSImpl::_wbBegin() {
+    if (_wb || !_cfg._writeBehind) {
+        return;
+    }
+    size_t pages = _blockSize / _pageSize;
+    _wbBlocks = _cfg._writeBehind;
+    _wb = new WBBlock[_wbBlocks];
+    _wbOps = new WBOp[_wbBlocks * (pages + 1)];
+    for (size_t i = 0; i < _wbBlocks; i++) {
+        _wb[i].data = new uint8_t[_blockSize];
+        _wb[i].queued = new uint8_t[pages];
+    }
+    _wbUsed = 0;
+    _wbOpCount = 0;
+}
+
+void LittleFSImpl::_wbEnd() {
+    if (!_wb) {
+        return;
+    }
+    _wbFlush();
+    for (size_t i = 0; i < _wbBlocks; i++) {
+        delete[] _wb[i].data;
+        delete[] _wb[i].queued;
+    }
+    delete[] _wb;
+    delete[] _wbOps;
+    _wb = nullptr;
+    _wbOps = nullptr;
+    _wbBlocks = 0;
+}
+
+LittleFSImpl::WBBlock *LittleFSImpl::_wbFind(lfs_block_t block) {
+    for (size_t i = 0; i < _wbUsed; i++) {
+        if (_wb[i].block == block) {
+            return &_wb[i];
+        }
+    }
+    return nullptr;
+}
+
+LittleFSImpl::WBBlock *LittleFSImpl::_wbGet(lfs_block_t block, bool load) {
+    WBBlock *b = _wbFind(block);
+    if (b) {
+        return b;
+    }
+    if (_wbUsed == _wbBlocks) {
+        _wbFlush();
+    }
+    b = &_wb[_wbUsed++];
+    b->block = block;
+    if (load) {
+        memcpy(b->data, _start + block * _blockSize, _blockSize);
+    }
+    memset(b->queued, 0, _blockSize / _pageSize);
+    return b;
+}
+
+void LittleFSImpl::_wbFlush() {
+    if (_wbOpCount) {
+        rp2040.idleOtherCore();
+        for (size_t i = 0; i < _wbOpCount; i++) {
+            WBBlock *b = &_wb[_wbOps[i].entry];
+            intptr_t addr = (intptr_t)_start + b->block * _blockSize - (intptr_t)XIP_BASE;
+            if (_wbOps[i].page < 0) {
+                // Erases are long, so let the other core run between them
+                if (i) {
+                    rp2040.resumeOtherCore();
+                    rp2040.idleOtherCore();
+                }
+                noInterrupts();
+                flash_range_erase(addr, _blockSize);
+            } else {
+                noInterrupts();
+                size_t first = _wbOps[i].page;
+                size_t last = first;
+                while ((i + 1 < _wbOpCount) && (_wbOps[i + 1].entry == _wbOps[i].entry) && (_wbOps[i + 1].page == (int16_t)(last + 1))) {
+                    last++;
+                    i++;
+                }
+                flash_range_program(addr + first * _pageSize, b->data + first * _pageSize, (last - first + 1) * _pageSize);
+            }
+            interrupts();
+        }
+        rp2040.resumeOtherCore();
+    }
+    _wbUsed = 0;
+    _wbOpCount = 0;
+}
 
 }; // namespace
 
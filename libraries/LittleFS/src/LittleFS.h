@@ -42,7 +42,48 @@ class LittleFSDirImpl;
 class LittleFSConfig : public FSConfig {
 public:
     static constexpr uint32_t FSId = 0x4c495454;
-    LittleFSConfig(bool autoFormat = true) : FSConfig(FSId, autoFormat) { }
+    LittleFSConfig(bool autoFormat = true) : FSConfig(FSId, autoFormat), _writeBehind(0), _readSize(256), _progSize(256), _cacheSize(256), _lookaheadSize(256), _blockCycles(16) { }
+
+    // Hold up to this many blocks of writes in RAM until littlefs syncs them, and then program
+    // them with the other core idled just once, instead of for every page.  0 disables it.
+    LittleFSConfig setWriteBehind(uint8_t blocks) {
+        _writeBehind = blocks;
+        return *this;
+    }
+
+    // littlefs geometry, checked at begin() or format().  Reads and programs are made in
+    // multiples of these, and must fit evenly in the cache, which must fit evenly in a 4K
+    // block.  Programs must also be whole 256 byte flash pages.  Larger caches mean fewer,
+    // bigger flash operations for long files, at the cost of RAM for every open file.
+    LittleFSConfig setReadSize(uint32_t size) {
+        _readSize = size;
+        return *this;
+    }
+    LittleFSConfig setProgSize(uint32_t size) {
+        _progSize = size;
+        return *this;
+    }
+    LittleFSConfig setCacheSize(uint32_t size) {
+        _cacheSize = size;
+        return *this;
+    }
+    // Bytes of free block bitmap searched at a time, a multiple of 8
+    LittleFSConfig setLookaheadSize(uint32_t size) {
+        _lookaheadSize = size;
+        return *this;
+    }
+    // Erases of a metadata block before it's moved for wear leveling, or -1 to never move them
+    LittleFSConfig setBlockCycles(int32_t cycles) {
+        _blockCycles = cycles;
+        return *this;
+    }
+
+    uint8_t _writeBehind;
+    uint32_t _readSize;
+    uint32_t _progSize;
+    uint32_t _cacheSize;
+    uint32_t _lookaheadSize;
+    int32_t _blockCycles;
 };
 
 class LittleFSImpl : public FSImpl {
@@ -76,6 +117,8 @@ public:
         if (_mounted) {
             lfs_unmount(&_lfs);
         }
+        _wbEnd();
+        _freeBuffers();
     }
 
     FileImplPtr open(const char* path, OpenMode openMode, AccessMode accessMode) override;
@@ -181,10 +224,15 @@ public:
             DEBUGV("LittleFS size is <= zero");
             return false;
         }
+        if (!_applyConfig()) {
+            return false;
+        }
+        _wbBegin();
         if (_tryMount()) {
             return true;
         }
         if (!_cfg._autoFormat || !format()) {
+            _wbEnd();
             return false;
         }
         return _tryMount();
@@ -196,6 +244,13 @@ public:
         }
         lfs_unmount(&_lfs);
         _mounted = false;
+        _wbEnd();
+        _freeBuffers();
+    }
+
+    bool sync() override {
+        _wbFlush();
+        return true;
     }
 
     bool format() override {
@@ -210,6 +265,10 @@ public:
             _mounted = false;
         }
 
+        if (!_applyConfig()) {
+            return false;
+        }
+
         memset(&_lfs, 0, sizeof(_lfs));
         int rc = lfs_format(&_lfs, &_lfs_cfg);
         if (rc != 0) {
@@ -334,6 +393,36 @@ protected:
     static int lfs_flash_erase(const struct lfs_config *c, lfs_block_t block);
     static int lfs_flash_sync(const struct lfs_config *c);
 
+    // Write-behind queue, see LittleFS.cpp
+    typedef struct {
+        lfs_block_t block;
+        uint8_t *data;    // The block as it will be once the queue is written
+        uint8_t *queued;  // Per page, whether it's already in _wbOps
+    } WBBlock;
+    typedef struct {
+        uint8_t entry;
+        int16_t page;     // -1 to erase the block
+    } WBOp;
+
+    bool _applyConfig();
+    void _freeBuffers();
+
+    uint8_t *_readBuffer = nullptr;
+    uint8_t *_progBuffer = nullptr;
+    uint8_t *_lookaheadBuffer = nullptr;
+
+    void _wbBegin();
+    void _wbEnd();
+    void _wbFlush();
+    WBBlock *_wbFind(lfs_block_t block);
+    WBBlock *_wbGet(lfs_block_t block, bool load);
+
+    WBBlock *_wb = nullptr;
+    WBOp *_wbOps = nullptr;
+    size_t _wbBlocks = 0;
+    size_t _wbUsed = 0;
+    size_t _wbOpCount = 0;
+
     lfs_t       _lfs;
     lfs_config  _lfs_cfg;
 
@@ -387,6 +476,35 @@ public:
         return result;
     }
 
+    // Data blocks only ever hold a file's contents after their skip-list pointers, so the
+    // rest of the block from the current position can be read in place through XIP
+    size_t mapRegion(const uint8_t **ptr, size_t len) override {
+        lfs_file_t *fd = _getFD();
+        if (!_opened || !fd || !ptr || !len || (_flags & LFS_O_WRONLY) || (fd->flags & LFS_F_INLINE)) {
+            return 0;    // Writable files can change under us, and inline ones are in metadata
+        }
+        size_t pos = position();
+        if (pos >= size()) {
+            return 0;
+        }
+        // Reading a byte has littlefs walk its skip-list to the block holding this position
+        uint8_t b;
+        if (lfs_file_read(_fs->getFS(), fd, &b, 1) != 1) {
+            return 0;
+        }
+        lfs_block_t block = fd->block;
+        lfs_off_t off = fd->off - 1;
+        if (_fs->_wbUsed) {
+            _fs->_wbFlush();    // Flash has to match what littlefs sees
+        }
+        len = std::min(len, std::min(size() - pos, (size_t)(_fs->_blockSize - off)));
+        if (lfs_file_seek(_fs->getFS(), fd, pos + len, LFS_SEEK_SET) < 0) {
+            return 0;
+        }
+        *ptr = _fs->_start + block * _fs->_blockSize + off;
+        return len;
+    }
+
     void flush() override {
         if (!_opened || !_fd) {
             return;
@@ -100,6 +100,14 @@ void MD5Builder::calculate(void) {
     br_md5_out(&_ctx, _buf);
 }
 
+uint64_t MD5Builder::getState(uint8_t state[16]) const {
+    return br_md5_state(&_ctx, state);
+}
+
+void MD5Builder::setState(const uint8_t state[16], uint64_t count) {
+    br_md5_set_state(&_ctx, state, count);
+}
+
 void MD5Builder::getBytes(uint8_t * output) const {
     memcpy(output, _buf, 16);
 }
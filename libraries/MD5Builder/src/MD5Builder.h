@@ -53,6 +53,10 @@ public:
     }
     bool addStream(Stream & stream, const size_t maxLen);
     void calculate(void);
+    // Saves the running state after a multiple of 64 bytes, returning the byte count, so
+    // the hash can be carried on later (even after a reset) with setState()
+    uint64_t getState(uint8_t state[16]) const;
+    void setState(const uint8_t state[16], uint64_t count);
     void getBytes(uint8_t * output) const;
     void getChars(char * output) const;
     String toString(void) const;
@@ -18,5 +18,63 @@
 */
 
 #include <PicoOTA.h>
+#include <CoreMutex.h>
+#include <hardware/dma.h>
+
+// Below this the DMA channel setup costs more than the table walk
+#define OTACRC32_DMA_MIN (64)
+
+static const uint32_t _crcNibble[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+// The sniffer works MSB-first on bit-reversed data, so its accumulator is the bit-reverse
+// of the usual reflected CRC state
+static inline uint32_t _bitrev32(uint32_t x) {
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+    return __builtin_bswap32(x);
+}
+
+auto_init_mutex(_crcSnifferMutex);
+
+bool OTACRC32::addDMA(const void *d, uint32_t len) {
+    CoreMutex m(&_crcSnifferMutex);
+    if (!m || (dma_hw->sniff_ctrl & DMA_SNIFF_CTRL_EN_BITS)) {
+        return false; // Someone else owns the sniffer
+    }
+    int ch = dma_claim_unused_channel(false);
+    if (ch < 0) {
+        return false;
+    }
+    static uint8_t sink;
+    dma_channel_config c = dma_channel_get_default_config(ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_sniff_enable(&c, true);
+    dma_hw->sniff_data = _bitrev32(crc);
+    dma_sniffer_enable(ch, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    dma_channel_configure(ch, &c, &sink, d, len, true);
+    dma_channel_wait_for_finish_blocking(ch);
+    crc = _bitrev32(dma_hw->sniff_data);
+    dma_sniffer_disable();
+    dma_channel_unclaim(ch);
+    return true;
+}
+
+void OTACRC32::add(const void *d, uint32_t len) {
+    if ((len >= OTACRC32_DMA_MIN) && addDMA(d, len)) {
+        return;
+    }
+    const uint8_t *data = (const uint8_t *)d;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ _crcNibble[crc & 15];
+        crc = (crc >> 4) ^ _crcNibble[crc & 15];
+    }
+}
 
 PicoOTA picoOTA;
@@ -26,7 +26,9 @@
 extern uint8_t _FS_start;
 extern uint8_t _FS_end;
 
-// Simple and low code CRC calculation for the OTA page
+// Standard (zlib/IEEE 802.3) CRC32.  Large buffers are run through the DMA sniffer, which
+// checksums at DMA speed, when a DMA channel and the sniffer are free.  Otherwise, and for
+// small buffers where the DMA setup would dominate, a 16-entry table is used.
 class OTACRC32 {
 public:
     OTACRC32() {
@@ -36,25 +38,14 @@ public:
     ~OTACRC32() {
     }
 
-    void add(const void *d, uint32_t len) {
-        const uint8_t *data = (const uint8_t *)d;
-        for (uint32_t i = 0; i < len; i++) {
-            crc ^= data[i];
-            for (int j = 0; j < 8; j++) {
-                if (crc & 1) {
-                    crc = (crc >> 1) ^ 0xedb88320;
-                } else {
-                    crc >>= 1;
-                }
-            }
-        }
-    }
+    void add(const void *d, uint32_t len);
 
     uint32_t get() {
         return ~crc;
     }
 
 private:
+    bool addDMA(const void *d, uint32_t len);
     uint32_t crc;
 };
 
@@ -76,7 +67,7 @@ public:
     }
 
     bool addFile(const char *filename, uint32_t offset = 0, uint32_t flashaddr = XIP_BASE, uint32_t len = 0) {
-        if (!_page  || _page->count == 8) {
+        if (!_page  || _page->count == _OTA_MAX_COMMANDS) {
             return false;
         }
         File f = LittleFS.open(filename, "r");
@@ -117,6 +108,64 @@ public:
         return true;
     }
 
+#ifdef _OTA_SLOT_FILE
+    // Makes the OTA shim boot the A/B slot at flashaddr on every reset from now on, as long as
+    // its first len bytes match crc32 on the first boot.  Takes effect at once and is kept apart
+    // from the command page, so neither begin() nor commit() is needed and later commits keep it.
+    bool setBootSlot(uint32_t flashaddr, uint32_t len, uint32_t crc32) {
+        uint8_t buff[256];
+        File f = LittleFS.open(_OTA_SLOT_FILE ".new", "w");
+        if (!f) {
+            return false;
+        }
+        size_t written = 0;
+        for (size_t i = 0; i < sizeof(OTASlot); i += sizeof(buff)) {
+            memset(buff, 0xff, sizeof(buff));
+            if (!i) {
+                OTASlot *s = (OTASlot *)buff;
+                memcpy(s->sign, "Pico A/B", sizeof(s->sign));
+                s->flashAddress = flashaddr;
+                s->length = len;
+                s->crc32 = crc32;
+            }
+            written += f.write(buff, sizeof(buff));
+        }
+        f.close();
+        // The rename swaps the selection in one LittleFS commit, so a power failure leaves
+        // either the old or the new slot selected
+        if ((written != sizeof(OTASlot)) || !LittleFS.rename(_OTA_SLOT_FILE ".new", _OTA_SLOT_FILE)) {
+            LittleFS.remove(_OTA_SLOT_FILE ".new");
+            return false;
+        }
+        return true;
+    }
+
+    // Goes back to booting the default app at XIP_BASE.  When flashaddr is given, only if
+    // that is the selected slot (e.g. because it is about to be overwritten).
+    void clearBootSlot(uint32_t flashaddr = 0) {
+        uint32_t start, len;
+        if (getBootSlot(&start, &len) && (!flashaddr || (flashaddr == start))) {
+            LittleFS.remove(_OTA_SLOT_FILE);
+        }
+    }
+
+    // The selected A/B slot, if any
+    bool getBootSlot(uint32_t *flashaddr, uint32_t *len) {
+        OTASlot s;
+        File f = LittleFS.open(_OTA_SLOT_FILE, "r");
+        if (!f) {
+            return false;
+        }
+        bool ok = (f.read((uint8_t *)&s, offsetof(OTASlot, reserved)) == offsetof(OTASlot, reserved)) && !memcmp(s.sign, "Pico A/B", sizeof(s.sign));
+        f.close();
+        if (ok) {
+            *flashaddr = s.flashAddress;
+            *len = s.length;
+        }
+        return ok;
+    }
+#endif
+
     bool commit() {
         if (!_page) {
             return false;
@@ -126,6 +175,18 @@ public:
         crc.add(_page, offsetof(OTACmdPage, crc32));
         _page->crc32 = crc.get();
 
+#ifdef _OTA_SLOT_FILE
+        // The shim only checks a selected slot once, so it must not outlive new contents
+        for (uint32_t i = 0; i < _page->count; i++) {
+            uint32_t start, len;
+            const commandEntry &c = _page->cmd[i];
+            if ((c.command == _OTA_WRITE) && getBootSlot(&start, &len) && (c.write.flashAddress < start + len) &&
+                    (c.write.flashAddress + c.write.fileLength > start)) {
+                clearBootSlot();
+            }
+        }
+#endif
+
         File f = LittleFS.open(_OTA_COMMAND_FILE, "w");
         if (!f) {
             return false;
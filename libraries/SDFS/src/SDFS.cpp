@@ -139,10 +139,54 @@ DirImplPtr SDFSImpl::openDir(const char* path) {
     return ret;
 }
 
+bool SDFSImpl::_beginSDIO() {
+#if USE_BLOCK_DEVICE_INTERFACE
+    _sdio = new SdioCardRP2040();
+    if (!_sdio->begin(_cfg._clkPin, _cfg._cmdPin, _cfg._dat0Pin, _cfg._sdioClock)) {
+        DEBUGV("SDFS::begin: SDIO card error %02x\n", _sdio->errorCode());
+        end();
+        return false;
+    }
+    _mounted = _fs.FatVolume::begin(_sdio);
+    if (!_mounted && _cfg._autoFormat) {
+        format();
+        _mounted = _fs.FatVolume::begin(_sdio);
+    }
+    if (!_mounted) {
+        end();
+        return false;
+    }
+    FsDateTime::setCallback(dateTimeCB);
+    return true;
+#else
+    DEBUGV("SDFS::begin: SDIO needs the whole build made with -DUSE_BLOCK_DEVICE_INTERFACE=1\n");
+    return false;
+#endif
+}
+
 bool SDFSImpl::format() {
     if (_mounted) {
         return false;
     }
+    if (_cfg._sdio) {
+#if USE_BLOCK_DEVICE_INTERFACE
+        // Reuse the card if begin() is retrying after a failed mount
+        SdioCardRP2040 *card = _sdio ? _sdio : new SdioCardRP2040();
+        bool ret = (card == _sdio) || card->begin(_cfg._clkPin, _cfg._cmdPin, _cfg._dat0Pin, _cfg._sdioClock);
+        if (ret) {
+            FatFormatter fatFormatter;
+            uint8_t *sectorBuffer = new uint8_t[512];
+            ret = fatFormatter.format(card, sectorBuffer, nullptr);
+            delete[] sectorBuffer;
+        }
+        if (card != _sdio) {
+            delete card;
+        }
+        return ret;
+#else
+        return false;
+#endif
+    }
     SdCardFactory cardFactory;
     SdCard* card = cardFactory.newCard(SdSpiConfig(_cfg._csPin, DEDICATED_SPI, _cfg._spiSettings));
     if (!card || card->errorCode()) {
@@ -34,6 +34,7 @@
 #include <SPI.h>
 #include <SdFat.h>
 #include <FS.h>
+#include "SdioCardRP2040.h"
 
 using namespace fs;
 
@@ -45,7 +46,7 @@ class SDFSConfig : public FSConfig {
 public:
     static constexpr uint32_t FSId = 0x53444653;
 
-    SDFSConfig(uint8_t csPin = 4, uint32_t spi = SD_SCK_MHZ(10), HardwareSPI &port = SPI) : FSConfig(FSId, false), _csPin(csPin), _part(0), _spiSettings(spi), _spi(&port)  { }
+    SDFSConfig(uint8_t csPin = 4, uint32_t spi = SD_SCK_MHZ(10), HardwareSPI &port = SPI) : FSConfig(FSId, false), _csPin(csPin), _part(0), _spiSettings(spi), _spi(&port), _dedicated(false), _sdio(false), _clkPin(0), _cmdPin(0), _dat0Pin(0), _sdioClock(25000000)  { }
 
     SDFSConfig setAutoFormat(bool val = true) {
         _autoFormat = val;
@@ -67,12 +68,35 @@ public:
         _part = part;
         return *this;
     }
+    // When nothing else uses this SPI bus, lets SdFat keep the card selected between calls,
+    // so consecutive sectors are streamed as one multi-block read or write
+    SDFSConfig setDedicatedSPI(bool dedicated = true) {
+        _dedicated = dedicated;
+        return *this;
+    }
+    // Talks to the card over its 4-bit SD bus from a PIO instead of over SPI.  DAT0-DAT3
+    // must be on consecutive GPIOs.  Only when every file is built with SdFat's
+    // USE_BLOCK_DEVICE_INTERFACE=1, otherwise begin() fails (see docs/fs.rst).
+    SDFSConfig setSDIO(uint8_t clkPin, uint8_t cmdPin, uint8_t dat0Pin, uint32_t clock = 25000000) {
+        _sdio = true;
+        _clkPin = clkPin;
+        _cmdPin = cmdPin;
+        _dat0Pin = dat0Pin;
+        _sdioClock = clock;
+        return *this;
+    }
 
     // Inherit _type and _autoFormat
     uint8_t   _csPin;
     uint8_t   _part;
     uint32_t  _spiSettings;
     HardwareSPI *_spi;
+    bool      _dedicated;
+    bool      _sdio;
+    uint8_t   _clkPin;
+    uint8_t   _cmdPin;
+    uint8_t   _dat0Pin;
+    uint32_t  _sdioClock;
 };
 
 class SDFSImpl : public FSImpl {
@@ -151,7 +175,10 @@ public:
         if (_mounted) {
             return true;
         }
-        SdSpiConfig ssc(_cfg._csPin, SHARED_SPI, _cfg._spiSettings, _cfg._spi);
+        if (_cfg._sdio) {
+            return _beginSDIO();
+        }
+        SdSpiConfig ssc(_cfg._csPin, _cfg._dedicated ? DEDICATED_SPI : SHARED_SPI, _cfg._spiSettings, _cfg._spi);
         _mounted = _fs.begin(ssc);
         if (!_mounted && _cfg._autoFormat) {
             format();
@@ -163,7 +190,8 @@ public:
 
     void end() override {
         _mounted = false;
-        // TODO
+        delete _sdio;
+        _sdio = nullptr;
     }
 
     bool format() override;
@@ -171,7 +199,7 @@ public:
     // The following are not common FS interfaces, but are needed only to
     // support the older SD.h exports
     uint8_t type() {
-        return _fs.card()->type();
+        return _sdio ? _sdio->type() : _fs.card()->type();
     }
     uint8_t fatType() {
         return _fs.vol()->fatType();
@@ -227,13 +255,20 @@ public:
     }
 
 protected:
-    friend class SDFileImpl;
+    friend class SDFSFileImpl;
     friend class SDFSDirImpl;
 
     SdFat* getFs() {
         return &_fs;
     }
 
+    bool _beginSDIO();
+
+    // SdFat only knows about the card when it opened it itself
+    bool _erase(uint32_t first, uint32_t last) {
+        return _sdio ? _sdio->erase(first, last) : _fs.card()->erase(first, last);
+    }
+
 
     static int _getFlags(OpenMode openMode, AccessMode accessMode) {
         int mode = 0;
@@ -257,6 +292,7 @@ protected:
     }
 
     SdFat _fs;
+    SdioCardRP2040 *_sdio = nullptr;
     SDFSConfig   _cfg;
     bool         _mounted;
 };
@@ -328,6 +364,19 @@ public:
         return _fd->truncate(size);
     }
 
+    bool preallocate(size_t size) override {
+        if (!_opened || !_fd->preAllocate(size)) {
+            DEBUGV("SDFSFileImpl::preallocate: unable to allocate %d bytes\n", size);
+            return false;
+        }
+        // Erasing the run now means the card needn't do it while the file is written
+        uint32_t first, last;
+        if (_fd->contiguousRange(&first, &last)) {
+            _fs->_erase(first, last);
+        }
+        return true;
+    }
+
     void close() override {
         if (_opened) {
             _fd->close();
@@ -0,0 +1,576 @@
+/*
+    SdioCardRP2040.cpp - SdFat card driver for the 4-bit SD bus, using PIO
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "SdioCardRP2040.h"
+#include <CoreMutex.h>
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include "sdio.pio.h"
+
+#define SDIO_INIT_TIMEOUT  2000
+#define SDIO_READ_TIMEOUT  1000
+#define SDIO_WRITE_TIMEOUT 2000
+#define SDIO_ERASE_TIMEOUT 10000
+
+// Card status bits which mean the command failed
+#define SDIO_R1_ERRORS 0xfdf98008
+
+// Nibbles in a sector, with the CRCs of the 4 lines
+#define SDIO_BLOCK_NIBBLES (1024 + 16)
+
+static uint8_t crc7(const uint8_t *data, int len) {
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++) {
+        uint8_t d = data[i];
+        for (int j = 0; j < 8; j++) {
+            crc <<= 1;
+            if ((d ^ crc) & 0x80) {
+                crc ^= 0x09;
+            }
+            d <<= 1;
+        }
+    }
+    return crc & 0x7f;
+}
+
+// The CRC16s of all four DAT lines at once.  Interleaved the way they're sent, the
+// lines' polynomial becomes x^64 + x^48 + x^20 + 1 and 8 clocks go in per word.
+// Returns the 64 CRC bits in the order they go out on the bus.
+static void crc16x4(const uint8_t *buf, uint32_t crc[2]) {
+    const uint32_t *p = (const uint32_t *)buf;
+    uint32_t hi = 0;
+    uint32_t lo = 0;
+    for (int i = 0; i < 128; i++) {
+        uint32_t t = hi ^ __builtin_bswap32(p[i]);
+        uint32_t u = t ^ (t >> 16);
+        hi = lo ^ (u << 16) ^ (u >> 12);
+        lo = u ^ (u << 20);
+    }
+    crc[0] = hi;
+    crc[1] = lo;
+}
+
+bool SdioCardRP2040::begin(uint8_t clkPin, uint8_t cmdPin, uint8_t dat0Pin, uint32_t clock) {
+    end();
+    _clk = clkPin;
+    _cmdPin = cmdPin;
+    _dat0 = dat0Pin;
+    _type = 0;
+    _rca = 0;
+    _ocr = 0;
+    _status = 0;
+    _error = SD_CARD_ERROR_NONE;
+    if (!_claim()) {
+        DEBUGV("SdioCardRP2040::begin: no free PIO or DMA channels\n");
+        return _fail(SD_CARD_ERROR_INIT_NOT_CALLED);
+    }
+    if (!_init(clock)) {
+        DEBUGV("SdioCardRP2040::begin: card init failed, error %d\n", _error);
+        end();
+        return false;
+    }
+    return true;
+}
+
+bool SdioCardRP2040::_init(uint32_t clock) {
+    // Identification runs at 400KHz at most
+    uint32_t sys = clock_get_hz(clk_sys);
+    uint16_t div = (sys + 799999) / 800000;
+    sdio_cmd_clk_program_init(_pio, _cmdSM, _cmdOff, _clk, _cmdPin, div);
+    sdio_data_rx_program_init(_pio, _rxSM, _rxOff, _dat0, div);
+    sdio_data_tx_program_init(_pio, _txSM, _txOff, _dat0, div);
+    // The receiver keeps the sector length in Y
+    pio_sm_put(_pio, _rxSM, SDIO_BLOCK_NIBBLES - 1);
+    pio_sm_exec(_pio, _rxSM, pio_encode_pull(false, false));
+    pio_sm_exec(_pio, _rxSM, pio_encode_out(pio_y, 32));
+    _setDivider(div);
+    delay(1); // At least 74 clocks before the first command
+
+    _cmd(0, 0, RESP_NONE);
+    // Only version 2 cards answer CMD8, echoing the check pattern
+    bool v2 = _cmd(8, 0x1aa, RESP_R6) && (_resp[4] == 0xaa);
+    uint32_t start = millis();
+    do {
+        if (!_acmd(41, v2 ? 0x40ff8000 : 0x00ff8000, RESP_R3) || (millis() - start > SDIO_INIT_TIMEOUT)) {
+            return _fail(SD_CARD_ERROR_ACMD41);
+        }
+    } while (!(_ocr & 0x80000000));
+    _type = !v2 ? SD_CARD_TYPE_SD1 : (_ocr & 0x40000000) ? SD_CARD_TYPE_SDHC : SD_CARD_TYPE_SD2;
+
+    if (!_cmd(2, 0, RESP_R2)) {
+        return _fail(SD_CARD_ERROR_CMD2);
+    }
+    memcpy(_cid, _resp + 1, sizeof(_cid));
+    if (!_cmd(3, 0, RESP_R6)) {
+        return _fail(SD_CARD_ERROR_CMD3);
+    }
+    _rca = (_resp[1] << 8) | _resp[2];
+    if (!_cmd(9, _rca << 16, RESP_R2)) {
+        return _fail(SD_CARD_ERROR_CMD9);
+    }
+    memcpy(_csd, _resp + 1, sizeof(_csd));
+    if (!_cmd(7, _rca << 16, RESP_R1) || !_waitBusy(SDIO_WRITE_TIMEOUT)) {
+        return _fail(SD_CARD_ERROR_CMD7);
+    }
+    // Switch the card over to all 4 DAT lines
+    if (!_acmd(6, 2, RESP_R1)) {
+        return _fail(SD_CARD_ERROR_ACMD6);
+    }
+
+    // Default speed tops out at 25MHz, and the PIO needs at least 3 cycles each half clock
+    if (!clock || (clock > 25000000)) {
+        clock = 25000000;
+    }
+    div = std::max((sys + 2 * clock - 1) / (2 * clock), (uint32_t)3);
+    _setDivider(div);
+    return true;
+}
+
+void SdioCardRP2040::end() {
+    if (_pio) {
+        _stopData();
+    }
+    _release();
+}
+
+bool SdioCardRP2040::_claim() {
+    // Fill in CLK for the transmitter's WAITs
+    memcpy(_txInsn, sdio_data_tx_program_instructions, sizeof(sdio_data_tx_program_instructions));
+    _txInsn[1] = pio_encode_wait_gpio(false, _clk);
+    _txInsn[2] = pio_encode_wait_gpio(true, _clk);
+    _txPgm.instructions = _txInsn;
+    _txPgm.length = sdio_data_tx_program.length;
+    _txPgm.origin = -1;
+
+    _dataDMA = dma_claim_unused_channel(false);
+    _ctrlDMA = dma_claim_unused_channel(false);
+    if ((_dataDMA < 0) || (_ctrlDMA < 0)) {
+        _release();
+        return false;
+    }
+
+    extern mutex_t _pioMutex;
+    CoreMutex m(&_pioMutex);
+    // Between them the programs need a whole, empty, PIO
+    for (int i = 0; i < 2; i++) {
+        PIO pio = i ? pio1 : pio0;
+        if (!pio_can_add_program(pio, &sdio_cmd_clk_program)) {
+            continue;
+        }
+        _cmdOff = pio_add_program(pio, &sdio_cmd_clk_program);
+        if (pio_can_add_program(pio, &sdio_data_rx_program)) {
+            _rxOff = pio_add_program(pio, &sdio_data_rx_program);
+            if (pio_can_add_program(pio, &_txPgm)) {
+                _txOff = pio_add_program(pio, &_txPgm);
+                _cmdSM = pio_claim_unused_sm(pio, false);
+                _rxSM = pio_claim_unused_sm(pio, false);
+                _txSM = pio_claim_unused_sm(pio, false);
+                if ((_cmdSM >= 0) && (_rxSM >= 0) && (_txSM >= 0)) {
+                    _pio = pio;
+                    return true;
+                }
+                for (int sm : { _cmdSM, _rxSM, _txSM }) {
+                    if (sm >= 0) {
+                        pio_sm_unclaim(pio, sm);
+                    }
+                }
+                pio_remove_program(pio, &_txPgm, _txOff);
+            }
+            pio_remove_program(pio, &sdio_data_rx_program, _rxOff);
+        }
+        pio_remove_program(pio, &sdio_cmd_clk_program, _cmdOff);
+    }
+    _release();
+    return false;
+}
+
+void SdioCardRP2040::_release() {
+    if (_pio) {
+        extern mutex_t _pioMutex;
+        CoreMutex m(&_pioMutex);
+        pio_set_sm_mask_enabled(_pio, (1u << _cmdSM) | (1u << _rxSM) | (1u << _txSM), false);
+        hw_clear_bits(&_pio->input_sync_bypass, 1u << _clk);
+        pio_remove_program(_pio, &sdio_cmd_clk_program, _cmdOff);
+        pio_remove_program(_pio, &sdio_data_rx_program, _rxOff);
+        pio_remove_program(_pio, &_txPgm, _txOff);
+        pio_sm_unclaim(_pio, _cmdSM);
+        pio_sm_unclaim(_pio, _rxSM);
+        pio_sm_unclaim(_pio, _txSM);
+        _pio = nullptr;
+    }
+    if (_dataDMA >= 0) {
+        dma_channel_unclaim(_dataDMA);
+        _dataDMA = -1;
+    }
+    if (_ctrlDMA >= 0) {
+        dma_channel_unclaim(_ctrlDMA);
+        _ctrlDMA = -1;
+    }
+}
+
+// The data SMs are stopped, and pick up the new divider in step with CLK when next started
+void SdioCardRP2040::_setDivider(uint16_t div) {
+    pio_sm_set_enabled(_pio, _cmdSM, false);
+    pio_sm_set_clkdiv_int_frac(_pio, _cmdSM, div, 0);
+    pio_sm_set_clkdiv_int_frac(_pio, _rxSM, div, 0);
+    pio_sm_set_clkdiv_int_frac(_pio, _txSM, div, 0);
+    pio_sm_set_enabled(_pio, _cmdSM, true);
+    _clock = clock_get_hz(clk_sys) / (2 * div);
+}
+
+bool SdioCardRP2040::_cmd(uint8_t cmd, uint32_t arg, int resp) {
+    uint8_t frame[5] = { (uint8_t)(0x40 | cmd), (uint8_t)(arg >> 24), (uint8_t)(arg >> 16), (uint8_t)(arg >> 8), (uint8_t)arg };
+    int len = (resp == RESP_R2) ? 136 : 48;
+    // Enough for the card to answer within its 64 clocks, and then the 8 clocks owed
+    // before the next command, which is all that's read when there's no answer
+    int bits = (resp == RESP_NONE) ? 8 : 64 + len + 8;
+    pio_sm_put_blocking(_pio, _cmdSM, (47u << 24) | ((bits - 1) << 16) | (frame[0] << 8) | frame[1]);
+    pio_sm_put_blocking(_pio, _cmdSM, (frame[2] << 24) | (frame[3] << 16) | (frame[4] << 8) | (crc7(frame, 5) << 1) | 1);
+    uint32_t w[7];
+    int n = (bits + 31) / 32;
+    for (int i = 0; i < n; i++) {
+        w[i] = pio_sm_get_blocking(_pio, _cmdSM);
+    }
+    if (resp == RESP_NONE) {
+        return true;
+    }
+    // The last push only held what was left, so line it up with the others
+    w[n - 1] <<= 32 * n - bits;
+
+    // The response starts at the first 0
+    int s = 0;
+    while ((s <= bits - len) && ((w[s / 32] >> (31 - s % 32)) & 1)) {
+        s++;
+    }
+    if (s > bits - len) {
+        return false;
+    }
+    memset(_resp, 0, sizeof(_resp));
+    for (int i = 0; i < len; i++, s++) {
+        if ((w[s / 32] >> (31 - s % 32)) & 1) {
+            _resp[i / 8] |= 0x80 >> (i % 8);
+        }
+    }
+    switch (resp) {
+    case RESP_R2:
+        return _resp[0] == 0x3f;
+    case RESP_R3:
+        // The OCR comes without a CRC
+        _ocr = (_resp[1] << 24) | (_resp[2] << 16) | (_resp[3] << 8) | _resp[4];
+        return _resp[0] == 0x3f;
+    default:
+        if ((_resp[0] != cmd) || (_resp[5] != ((crc7(_resp, 5) << 1) | 1))) {
+            return false;
+        }
+        _status = (_resp[1] << 24) | (_resp[2] << 16) | (_resp[3] << 8) | _resp[4];
+        if (resp == RESP_R6) {
+            return true;
+        }
+        // A read running on to the end of the card is only flagged once it's stopped
+        return !(_status & (cmd == 12 ? SDIO_R1_ERRORS & ~0x80000000 : SDIO_R1_ERRORS));
+    }
+}
+
+// The card holds DAT0 low while it's busy
+bool SdioCardRP2040::_waitBusy(uint32_t ms) {
+    uint32_t start = millis();
+    while (!gpio_get(_dat0)) {
+        if (millis() - start > ms) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Only called between commands, so stopping CLK for a moment is harmless, and
+// restarting all the dividers together puts the data SM in step with CLK
+void SdioCardRP2040::_startData(int sm) {
+    pio_sm_set_enabled(_pio, _cmdSM, false);
+    pio_enable_sm_mask_in_sync(_pio, (1u << _cmdSM) | (1u << sm));
+}
+
+void SdioCardRP2040::_stopData() {
+    pio_set_sm_mask_enabled(_pio, (1u << _rxSM) | (1u << _txSM), false);
+    // Pause and unchain the data channel first, so that nothing restarts either one
+    dma_channel_config c = dma_channel_get_default_config(_dataDMA);
+    channel_config_set_enable(&c, false);
+    dma_channel_set_config(_dataDMA, &c, false);
+    dma_channel_abort(_ctrlDMA);
+    dma_channel_abort(_dataDMA);
+    for (int sm : { _rxSM, _txSM }) {
+        pio_sm_clear_fifos(_pio, sm);
+        pio_sm_restart(_pio, sm);
+    }
+    pio_sm_exec(_pio, _rxSM, pio_encode_jmp(_rxOff));
+    pio_sm_exec(_pio, _txSM, pio_encode_jmp(_txOff));
+    // Let go of DAT, and leave it high for the next start bit
+    pio_sm_exec(_pio, _txSM, pio_encode_set(pio_pindirs, 0));
+    pio_sm_exec(_pio, _txSM, pio_encode_set(pio_pins, 15));
+}
+
+bool SdioCardRP2040::_readBlocks(uint32_t sector, uint8_t *dst, size_t ns) {
+    // One control block for each sector's data and one for its CRCs, then a null one to stop
+    for (size_t i = 0; i < ns; i++) {
+        _dmaList[2 * i].addr = (uint32_t)(dst + 512 * i);
+        _dmaList[2 * i].count = 128;
+        _dmaList[2 * i + 1].addr = (uint32_t)_crc[i];
+        _dmaList[2 * i + 1].count = 2;
+    }
+    _dmaList[2 * ns].addr = 0;
+    _dmaList[2 * ns].count = 0;
+
+    // The bytes of each word arrive MSB first, so swapping puts them in order
+    dma_channel_config c = dma_channel_get_default_config(_dataDMA);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(_pio, _rxSM, false));
+    channel_config_set_bswap(&c, true);
+    channel_config_set_chain_to(&c, _ctrlDMA);
+    dma_channel_configure(_dataDMA, &c, nullptr, &_pio->rxf[_rxSM], 0, false);
+    c = dma_channel_get_default_config(_ctrlDMA);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, 3);
+    dma_channel_configure(_ctrlDMA, &c, &dma_hw->ch[_dataDMA].al1_write_addr, _dmaList, 2, true);
+    _startData(_rxSM);
+
+    if (!_cmd(ns > 1 ? 18 : 17, _addr(sector), RESP_R1)) {
+        _stopData();
+        return _fail(ns > 1 ? SD_CARD_ERROR_CMD18 : SD_CARD_ERROR_CMD17);
+    }
+    // Each sector is done once the control channel has set up the next, so its
+    // CRCs are checked while the next sector arrives
+    uint8_t err = SD_CARD_ERROR_NONE;
+    uint32_t start = millis();
+    for (size_t i = 0; (i < ns) && !err; i++) {
+        while (dma_hw->ch[_ctrlDMA].read_addr < (uint32_t)&_dmaList[2 * i + 3]) {
+            if (millis() - start > SDIO_READ_TIMEOUT) {
+                err = SD_CARD_ERROR_READ_TIMEOUT;
+                break;
+            }
+        }
+        uint32_t crc[2];
+        crc16x4(dst + 512 * i, crc);
+        if (!err && ((crc[0] != __builtin_bswap32(_crc[i][0])) || (crc[1] != __builtin_bswap32(_crc[i][1])))) {
+            err = SD_CARD_ERROR_READ_CRC;
+        }
+        start = millis();
+    }
+    // The card will have gone on to the next sector, which the stop cuts short
+    if ((ns > 1) && !_cmd(12, 0, RESP_R1) && !err) {
+        err = SD_CARD_ERROR_CMD12;
+    }
+    _stopData();
+    if (!_waitBusy(SDIO_WRITE_TIMEOUT) && !err) {
+        err = SD_CARD_ERROR_CMD12;
+    }
+    return err ? _fail(err) : true;
+}
+
+bool SdioCardRP2040::_writeAcks(size_t *acked) {
+    bool ok = true;
+    while (!pio_sm_is_rx_fifo_empty(_pio, _txSM)) {
+        // CRC status 010 and the end bit mean the sector was accepted
+        ok = ok && ((pio_sm_get(_pio, _txSM) & 0xf) == 0x5);
+        (*acked)++;
+    }
+    return ok;
+}
+
+bool SdioCardRP2040::_writeBlocks(uint32_t sector, const uint8_t *src, size_t ns) {
+    if (ns == 1) {
+        if (!_cmd(24, _addr(sector), RESP_R1)) {
+            return _fail(SD_CARD_ERROR_CMD24);
+        }
+    } else {
+        // Knowing how many sectors are coming lets the card erase them up front
+        if (!_acmd(23, ns, RESP_R1)) {
+            return _fail(SD_CARD_ERROR_ACMD23);
+        }
+        if (!_cmd(25, _addr(sector), RESP_R1)) {
+            return _fail(SD_CARD_ERROR_CMD25);
+        }
+    }
+    _startData(_txSM);
+
+    // The SM holds each sector behind its length and sends it once the card has
+    // finished with the last, so the next one can be queued as soon as the DMA
+    // channels are free.  Its CRCs are worked out while the last is on the bus.
+    uint8_t err = SD_CARD_ERROR_NONE;
+    size_t acked = 0;
+    uint32_t start = millis();
+    for (size_t i = 0; (i < ns) && !err; i++) {
+        const uint8_t *buf = src + 512 * i;
+        uint32_t crc[2];
+        crc16x4(buf, crc);
+        while (dma_channel_is_busy(_dataDMA) || dma_channel_is_busy(_ctrlDMA) || pio_sm_is_tx_fifo_full(_pio, _txSM)) {
+            if (millis() - start > SDIO_WRITE_TIMEOUT) {
+                err = SD_CARD_ERROR_WRITE_TIMEOUT;
+                break;
+            }
+        }
+        if (err) {
+            break;
+        }
+        _crc[0][0] = crc[0];
+        _crc[0][1] = crc[1];
+        dma_channel_config c = dma_channel_get_default_config(_ctrlDMA);
+        channel_config_set_dreq(&c, pio_get_dreq(_pio, _txSM, true));
+        dma_channel_configure(_ctrlDMA, &c, &_pio->txf[_txSM], _crc[0], 2, false);
+        c = dma_channel_get_default_config(_dataDMA);
+        channel_config_set_dreq(&c, pio_get_dreq(_pio, _txSM, true));
+        channel_config_set_bswap(&c, true);
+        channel_config_set_chain_to(&c, _ctrlDMA);
+        dma_channel_configure(_dataDMA, &c, &_pio->txf[_txSM], buf, 128, false);
+        // Once the SM has the length it won't wait for the data, so it must follow right behind
+        noInterrupts();
+        pio_sm_put(_pio, _txSM, SDIO_BLOCK_NIBBLES - 1);
+        dma_channel_start(_dataDMA);
+        interrupts();
+        if (!_writeAcks(&acked)) {
+            err = SD_CARD_ERROR_WRITE_DATA;
+        }
+        start = millis();
+    }
+    // The last ack only comes once the card is no longer busy
+    while (!err && (acked < ns)) {
+        if (!_writeAcks(&acked)) {
+            err = SD_CARD_ERROR_WRITE_DATA;
+        } else if (millis() - start > SDIO_WRITE_TIMEOUT) {
+            err = SD_CARD_ERROR_WRITE_TIMEOUT;
+        }
+    }
+    if (((ns > 1) || err) && !_cmd(12, 0, RESP_R1) && !err) {
+        err = SD_CARD_ERROR_CMD12;
+    }
+    _stopData();
+    if (!_waitBusy(SDIO_WRITE_TIMEOUT) && !err) {
+        err = SD_CARD_ERROR_WRITE_TIMEOUT;
+    }
+    return err ? _fail(err) : true;
+}
+
+bool SdioCardRP2040::readSector(uint32_t sector, uint8_t *dst) {
+    return readSectors(sector, dst, 1);
+}
+
+bool SdioCardRP2040::readSectors(uint32_t sector, uint8_t *dst, size_t ns) {
+    // DMA and the CRCs go a word at a time, so unaligned buffers go via our own
+    if ((uint32_t)dst & 3) {
+        for (size_t i = 0; i < ns; i++) {
+            if (!_readBlocks(sector + i, (uint8_t *)_bounce, 1)) {
+                return false;
+            }
+            memcpy(dst + 512 * i, _bounce, 512);
+        }
+        return true;
+    }
+    while (ns) {
+        size_t n = std::min(ns, (size_t)SDIO_MAX_BLOCKS);
+        if (!_readBlocks(sector, dst, n)) {
+            return false;
+        }
+        sector += n;
+        dst += 512 * n;
+        ns -= n;
+    }
+    return true;
+}
+
+bool SdioCardRP2040::writeSector(uint32_t sector, const uint8_t *src) {
+    return writeSectors(sector, src, 1);
+}
+
+bool SdioCardRP2040::writeSectors(uint32_t sector, const uint8_t *src, size_t ns) {
+    if ((uint32_t)src & 3) {
+        for (size_t i = 0; i < ns; i++) {
+            memcpy(_bounce, src + 512 * i, 512);
+            if (!_writeBlocks(sector + i, (const uint8_t *)_bounce, 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return _writeBlocks(sector, src, ns);
+}
+
+bool SdioCardRP2040::erase(uint32_t firstSector, uint32_t lastSector) {
+    // Without ERASE_BLK_EN only whole erase groups can go
+    if (!(_csd[10] & 0x40)) {
+        uint8_t m = ((_csd[10] & 0x3f) << 1) | (_csd[11] >> 7);
+        if ((firstSector & m) || ((lastSector + 1) & m)) {
+            return _fail(SD_CARD_ERROR_ERASE_SINGLE_SECTOR);
+        }
+    }
+    if (!_cmd(32, _addr(firstSector), RESP_R1)) {
+        return _fail(SD_CARD_ERROR_CMD32);
+    }
+    if (!_cmd(33, _addr(lastSector), RESP_R1)) {
+        return _fail(SD_CARD_ERROR_CMD33);
+    }
+    if (!_cmd(38, 0, RESP_R1)) {
+        return _fail(SD_CARD_ERROR_CMD38);
+    }
+    if (!_waitBusy(SDIO_ERASE_TIMEOUT)) {
+        return _fail(SD_CARD_ERROR_ERASE_TIMEOUT);
+    }
+    return true;
+}
+
+bool SdioCardRP2040::isBusy() {
+    return !gpio_get(_dat0);
+}
+
+bool SdioCardRP2040::syncDevice() {
+    if (!_waitBusy(SDIO_WRITE_TIMEOUT)) {
+        return _fail(SD_CARD_ERROR_WRITE_TIMEOUT);
+    }
+    return true;
+}
+
+bool SdioCardRP2040::readCID(cid_t *cid) {
+    memcpy(cid, _cid, sizeof(_cid));
+    return true;
+}
+
+bool SdioCardRP2040::readCSD(csd_t *csd) {
+    memcpy(csd, _csd, sizeof(_csd));
+    return true;
+}
+
+bool SdioCardRP2040::readOCR(uint32_t *ocr) {
+    *ocr = _ocr;
+    return true;
+}
+
+uint32_t SdioCardRP2040::sectorCount() {
+    // Version 2 (SDHC) CSDs give the size in 512KB units
+    if ((_csd[0] >> 6) == 1) {
+        uint32_t size = ((_csd[7] & 0x3f) << 16) | (_csd[8] << 8) | _csd[9];
+        return (size + 1) << 10;
+    }
+    uint32_t size = ((_csd[6] & 0x03) << 10) | (_csd[7] << 2) | (_csd[8] >> 6);
+    uint8_t mult = ((_csd[9] & 0x03) << 1) | (_csd[10] >> 7);
+    uint8_t blockLen = _csd[5] & 0x0f;
+    return (size + 1) << (mult + blockLen - 7);
+}
+
+uint32_t SdioCardRP2040::status() {
+    return _cmd(13, _rca << 16, RESP_R6) ? _status : 0xffffffff;
+}
@@ -0,0 +1,121 @@
+/*
+    SdioCardRP2040.h - SdFat card driver for the 4-bit SD bus, using PIO
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include <hardware/pio.h>
+
+// Sectors moved by one DMA control list, the rest of a read continues with another
+#define SDIO_MAX_BLOCKS 32
+
+// Drives an SD card in 4-bit mode from a whole PIO (3 SMs) and 2 DMA channels.
+// DAT0-DAT3 must be consecutive GPIOs, while CLK and CMD can be anywhere.
+class SdioCardRP2040 : public SdCardInterface {
+public:
+    SdioCardRP2040() { }
+    ~SdioCardRP2040() {
+        end();
+    }
+
+    // The clock is limited to 25MHz and to 1/6 of the system clock
+    bool begin(uint8_t clkPin, uint8_t cmdPin, uint8_t dat0Pin, uint32_t clock = 25000000);
+    void end();
+
+    bool erase(uint32_t firstSector, uint32_t lastSector);
+    uint8_t errorCode() const {
+        return _error;
+    }
+    uint32_t errorData() const {
+        return _status;
+    }
+    bool isBusy();
+    bool readCID(cid_t *cid);
+    bool readCSD(csd_t *csd);
+    bool readOCR(uint32_t *ocr);
+    bool readSector(uint32_t sector, uint8_t *dst);
+    bool readSectors(uint32_t sector, uint8_t *dst, size_t ns);
+    uint32_t sectorCount();
+    uint32_t status();
+    bool syncDevice();
+    uint8_t type() const {
+        return _type;
+    }
+    bool writeSector(uint32_t sector, const uint8_t *src);
+    bool writeSectors(uint32_t sector, const uint8_t *src, size_t ns);
+
+    // The SD clock actually in use, after rounding the PIO divider
+    uint32_t clock() const {
+        return _clock;
+    }
+
+private:
+    // R6 and R7 are checked like R1, but their status is left to the caller
+    enum { RESP_NONE, RESP_R1, RESP_R2, RESP_R3, RESP_R6 };
+
+    bool _init(uint32_t clock);
+    bool _claim();
+    void _release();
+    void _setDivider(uint16_t div);
+    bool _cmd(uint8_t cmd, uint32_t arg, int resp);
+    bool _acmd(uint8_t cmd, uint32_t arg, int resp) {
+        return _cmd(55, _rca << 16, RESP_R1) && _cmd(cmd, arg, resp);
+    }
+    bool _waitBusy(uint32_t ms);
+    void _startData(int sm);
+    void _stopData();
+    bool _readBlocks(uint32_t sector, uint8_t *dst, size_t ns);
+    bool _writeAcks(size_t *acked);
+    bool _writeBlocks(uint32_t sector, const uint8_t *src, size_t ns);
+    uint32_t _addr(uint32_t sector) {
+        return _type == SD_CARD_TYPE_SDHC ? sector : sector << 9;
+    }
+    bool _fail(uint8_t code) {
+        _error = code;
+        return false;
+    }
+
+    PIO      _pio = nullptr;
+    int      _cmdSM, _rxSM, _txSM;
+    int      _cmdOff, _rxOff, _txOff;
+    int      _dataDMA = -1;
+    int      _ctrlDMA = -1;
+    uint16_t _txInsn[32];
+    pio_program_t _txPgm;
+    uint8_t  _clk;
+    uint8_t  _cmdPin;
+    uint8_t  _dat0;
+    uint32_t _clock = 0;
+    uint8_t  _type = 0;
+    uint8_t  _error = SD_CARD_ERROR_NONE;
+    uint32_t _status = 0;
+    uint32_t _ocr = 0;
+    uint16_t _rca = 0;
+    uint8_t  _cid[16];
+    uint8_t  _csd[16];
+    uint8_t  _resp[17];
+    // DMA control blocks, written to the data channel's WRITE_ADDR and TRANS_COUNT_TRIG
+    struct {
+        uint32_t addr;
+        uint32_t count;
+    } _dmaList[2 * SDIO_MAX_BLOCKS + 1];
+    uint32_t _crc[SDIO_MAX_BLOCKS][2];
+    uint32_t _bounce[128];
+};
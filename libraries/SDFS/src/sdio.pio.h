@@ -0,0 +1,168 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------------ //
+// sdio_cmd_clk //
+// ------------ //
+
+#define sdio_cmd_clk_wrap_target 0
+#define sdio_cmd_clk_wrap 11
+
+static const uint16_t sdio_cmd_clk_program_instructions[] = {
+    //     .wrap_target
+    0xa04d, //  0: mov    y, !status      side 0
+    0x1060, //  1: jmp    !y, 0           side 1
+    0x6028, //  2: out    x, 8            side 0
+    0x7048, //  3: out    y, 8            side 1
+    0x6001, //  4: out    pins, 1         side 0
+    0x1044, //  5: jmp    x--, 4          side 1
+    0x0061, //  6: jmp    !y, 1           side 0
+    0xf080, //  7: set    pindirs, 0      side 1
+    0x4001, //  8: in     pins, 1         side 0
+    0x1088, //  9: jmp    y--, 8          side 1
+    0x8020, // 10: push   block           side 0
+    0xf081, // 11: set    pindirs, 1      side 1
+    //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program sdio_cmd_clk_program = {
+    .instructions = sdio_cmd_clk_program_instructions,
+    .length = 12,
+    .origin = -1,
+};
+
+static inline pio_sm_config sdio_cmd_clk_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + sdio_cmd_clk_wrap_target, offset + sdio_cmd_clk_wrap);
+    sm_config_set_sideset(&c, 1, false, false);
+    return c;
+}
+
+static inline void sdio_cmd_clk_program_init(PIO pio, uint sm, uint offset, uint clk, uint cmd, uint16_t div) {
+    pio_sm_set_pins_with_mask(pio, sm, 1u << cmd, (1u << clk) | (1u << cmd));
+    pio_sm_set_pindirs_with_mask(pio, sm, (1u << clk) | (1u << cmd), (1u << clk) | (1u << cmd));
+    pio_gpio_init(pio, clk);
+    pio_gpio_init(pio, cmd);
+    gpio_pull_up(cmd);
+    // CLK is ours and needn't be synchronized, so WAITs on it complete a fixed tick later
+    hw_set_bits(&pio->input_sync_bypass, 1u << clk);
+    pio_sm_config c = sdio_cmd_clk_program_get_default_config(offset);
+    sm_config_set_sideset_pins(&c, clk);
+    sm_config_set_out_pins(&c, cmd, 1);
+    sm_config_set_set_pins(&c, cmd, 1);
+    sm_config_set_in_pins(&c, cmd);
+    // MSB first both ways, with autopull and autopush a word at a time
+    sm_config_set_out_shift(&c, false, true, 32);
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_mov_status(&c, STATUS_TX_LESSTHAN, 1);
+    sm_config_set_clkdiv_int_frac(&c, div, 0);
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+#endif
+
+// ------------ //
+// sdio_data_rx //
+// ------------ //
+
+#define sdio_data_rx_wrap_target 0
+#define sdio_data_rx_wrap 4
+
+static const uint16_t sdio_data_rx_program_instructions[] = {
+    //     .wrap_target
+    0xa022, //  0: mov    x, y
+    0x2020, //  1: wait   0 pin, 0
+    0xa142, //  2: nop                    [1]
+    0x4004, //  3: in     pins, 4
+    0x0043, //  4: jmp    x--, 3
+    //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program sdio_data_rx_program = {
+    .instructions = sdio_data_rx_program_instructions,
+    .length = 5,
+    .origin = -1,
+};
+
+static inline pio_sm_config sdio_data_rx_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + sdio_data_rx_wrap_target, offset + sdio_data_rx_wrap);
+    return c;
+}
+
+static inline void sdio_data_rx_program_init(PIO pio, uint sm, uint offset, uint dat0, uint16_t div) {
+    pio_sm_set_consecutive_pindirs(pio, sm, dat0, 4, false);
+    for (int i = 0; i < 4; i++) {
+        pio_gpio_init(pio, dat0 + i);
+        gpio_pull_up(dat0 + i);
+    }
+    pio_sm_config c = sdio_data_rx_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, dat0);
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_clkdiv_int_frac(&c, div, 0);
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+#endif
+
+// ------------ //
+// sdio_data_tx //
+// ------------ //
+
+#define sdio_data_tx_wrap_target 0
+#define sdio_data_tx_wrap 14
+
+static const uint16_t sdio_data_tx_program_instructions[] = {
+    //     .wrap_target
+    0x6020, //  0: out    x, 32
+    0x2000, //  1: wait   0 gpio, 0
+    0x2080, //  2: wait   1 gpio, 0
+    0xe08f, //  3: set    pindirs, 15
+    0xe100, //  4: set    pins, 0         [1]
+    0x6004, //  5: out    pins, 4
+    0x0045, //  6: jmp    x--, 5
+    0xe10f, //  7: set    pins, 15        [1]
+    0xe080, //  8: set    pindirs, 0
+    0x2020, //  9: wait   0 pin, 0
+    0xe123, // 10: set    x, 3            [1]
+    0x4001, // 11: in     pins, 1
+    0x004b, // 12: jmp    x--, 11
+    0x20a0, // 13: wait   1 pin, 0
+    0x8020, // 14: push   block
+    //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program sdio_data_tx_program = {
+    .instructions = sdio_data_tx_program_instructions,
+    .length = 15,
+    .origin = -1,
+};
+
+static inline pio_sm_config sdio_data_tx_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + sdio_data_tx_wrap_target, offset + sdio_data_tx_wrap);
+    return c;
+}
+
+static inline void sdio_data_tx_program_init(PIO pio, uint sm, uint offset, uint dat0, uint16_t div) {
+    pio_sm_set_pins_with_mask(pio, sm, 15u << dat0, 15u << dat0);
+    pio_sm_set_consecutive_pindirs(pio, sm, dat0, 4, false);
+    pio_sm_config c = sdio_data_tx_program_get_default_config(offset);
+    sm_config_set_out_pins(&c, dat0, 4);
+    sm_config_set_set_pins(&c, dat0, 4);
+    sm_config_set_in_pins(&c, dat0);
+    sm_config_set_out_shift(&c, false, true, 32);
+    sm_config_set_in_shift(&c, false, false, 32);
+    sm_config_set_clkdiv_int_frac(&c, div, 0);
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+#endif
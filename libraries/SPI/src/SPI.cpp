@@ -21,6 +21,10 @@
 #include "SPI.h"
 #include <hardware/spi.h>
 #include <hardware/gpio.h>
+#include <hardware/dma.h>
+
+// Below this many bytes setting up DMA costs more than feeding the FIFO directly
+#define SPI_DMA_MIN 32
 
 #ifdef USE_TINYUSB
 // For Serial when selecting TinyUSB.  Can't include in the core because Arduino IDE
@@ -132,6 +136,11 @@ uint16_t SPIClassRP2040::transfer16(uint16_t data) {
 
 void SPIClassRP2040::transfer(void *buf, size_t count) {
     DEBUGSPI("SPI::transfer(%p, %d)\n", buf, count);
+    if (_spis.getBitOrder() == MSBFIRST) {
+        // Each byte goes out before its reply comes back, so this can be done in place
+        transfer(buf, buf, count);
+        return;
+    }
     uint8_t *buff = reinterpret_cast<uint8_t *>(buf);
     for (size_t i = 0; i < count; i++) {
         *buff = transfer(*buff);
@@ -154,6 +163,9 @@ void SPIClassRP2040::transfer(const void *txbuf, void *rxbuf, size_t count) {
     if (_spis.getBitOrder() == MSBFIRST) {
         spi_set_format(_spi, 8, cpol(), cpha(), SPI_MSB_FIRST);
 
+        if ((count >= SPI_DMA_MIN) && transferDMA(txbuff, rxbuff, count)) {
+            return;
+        }
         if (rxbuf == nullptr) { // transmit only!
             spi_write_blocking(_spi, txbuff, count);
             return;
@@ -177,6 +189,43 @@ void SPIClassRP2040::transfer(const void *txbuf, void *rxbuf, size_t count) {
     DEBUGSPI("SPI::transfer completed\n");
 }
 
+// One channel feeds the TX FIFO and another drains RX, so the bus never waits on the CPU.
+// With no txbuf 0xff is sent, like spi_read_blocking(), and with no rxbuf replies are dropped
+bool SPIClassRP2040::transferDMA(const uint8_t *txbuf, uint8_t *rxbuf, size_t count) {
+    int tx = dma_claim_unused_channel(false);
+    if (tx < 0) {
+        return false;
+    }
+    int rx = dma_claim_unused_channel(false);
+    if (rx < 0) {
+        dma_channel_unclaim(tx);
+        return false;
+    }
+    static const uint8_t ones = 0xff;
+    static uint8_t sink;
+
+    dma_channel_config c = dma_channel_get_default_config(tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(_spi, true));
+    channel_config_set_read_increment(&c, txbuf != nullptr);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(tx, &c, &spi_get_hw(_spi)->dr, txbuf ? txbuf : &ones, count, false);
+
+    c = dma_channel_get_default_config(rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, spi_get_dreq(_spi, false));
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, rxbuf != nullptr);
+    dma_channel_configure(rx, &c, rxbuf ? rxbuf : &sink, &spi_get_hw(_spi)->dr, count, false);
+
+    // Start both together, and once the last byte is received the transfer is over
+    dma_start_channel_mask((1u << tx) | (1u << rx));
+    dma_channel_wait_for_finish_blocking(rx);
+    dma_channel_unclaim(tx);
+    dma_channel_unclaim(rx);
+    return true;
+}
+
 void SPIClassRP2040::beginTransaction(SPISettings settings) {
     DEBUGSPI("SPI::beginTransaction(clk=%d, bo=%s\n", _spis.getClockFreq(), (_spis.getBitOrder() == MSBFIRST) ? "MSB" : "LSB");
     if (_initted && settings == _spis) {
@@ -36,6 +36,7 @@ public:
     void transfer(void *buf, size_t count) override;
 
     // Sends one buffer and receives into another, much faster! can set rx or txbuf to nullptr
+    // Larger MSB-first transfers are done by DMA
     void transfer(const void *txbuf, void *rxbuf, size_t count) override;
 
     // Call before/after every complete transaction
@@ -76,6 +77,7 @@ private:
     uint8_t reverseByte(uint8_t b);
     uint16_t reverse16Bit(uint16_t w);
     void adjustBuffer(const void *s, void *d, size_t cnt, bool by16);
+    bool transferDMA(const uint8_t *txbuf, uint8_t *rxbuf, size_t count);
 
     spi_inst_t *_spi;
     SPISettings _spis;
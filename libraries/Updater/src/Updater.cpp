@@ -32,6 +32,30 @@
 
 extern uint8_t _FS_start;
 extern uint8_t _FS_end;
+extern uint8_t _EEPROM_start;
+extern uint8_t _FLASH_length;
+extern uint8_t __flash_binary_start;
+
+// Slots start with a boot2/OTA/partition prefix, the vector table follows it
+#define UPDATER_SLOT_VECTORS (0x3000)
+// Raw flash updates erase this far ahead at once, letting the flash use 64K block erases
+#define UPDATER_ERASE_AHEAD  (64 * 1024)
+// writeStream() hashes and programs this much between stream reads
+#define UPDATER_STEP         (1024)
+// Resumable U_FLASH updates record their progress in LittleFS this often
+#define UPDATER_CHECKPOINT   (64 * 1024)
+#define UPDATER_RESUME_FILE  "updater.rsm"
+#define UPDATER_RESUME_MAGIC (0x4d535255) // "URSM"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t command;
+    uint32_t start;
+    uint32_t size;
+    uint32_t done;    // Bytes safely in flash, a multiple of the buffer size
+    uint8_t md5[16];  // MD5 state after them
+    // Followed by the tag
+} UpdaterCheckpoint;
 
 
 #if ARDUINO_SIGNING
@@ -65,10 +89,37 @@ void UpdaterClass::_reset() {
     }
     _buffer = 0;
     _bufferLen = 0;
+    if (_back) {
+        delete[] _back;
+    }
+    _back = nullptr;
+    _backLen = 0;
     _startAddress = 0;
     _currentAddress = 0;
     _size = 0;
     _command = U_FLASH;
+    _slot = false;
+    _erasedTo = 0;
+}
+
+// Sketches linked with a flash length of at most half the sketch area get a second, A/B,
+// slot right after the first one.  Returns the slot not being run from.  Only once the OTA
+// shim in lib/ota.o can boot a slot, which its ota_command.h shows by defining _OTA_SLOT_FILE.
+bool UpdaterClass::_findSlot(uint32_t *addr, uint32_t *len) {
+#ifndef _OTA_SLOT_FILE
+    (void) addr;
+    (void) len;
+    return false;
+#else
+    uint32_t slotLen = (uint32_t)&_FLASH_length;
+    uint32_t limit = std::min((uint32_t)&_FS_start, (uint32_t)&_EEPROM_start);
+    if ((&_FS_start == &_FS_end) || (slotLen & 4095) || (XIP_BASE + 2 * slotLen > limit)) {
+        return false; // The OTA shim needs LittleFS to record the slot to boot
+    }
+    *addr = ((uint32_t)&__flash_binary_start == XIP_BASE) ? XIP_BASE + slotLen : XIP_BASE;
+    *len = slotLen;
+    return true;
+#endif
 }
 
 bool UpdaterClass::begin(size_t size, int command) {
@@ -96,15 +147,24 @@ bool UpdaterClass::begin(size_t size, int command) {
     _target_md5 = "";
     _md5 = MD5Builder();
 
-    if (command == U_FLASH) {
+    uint32_t slotLen;
+    if ((command == U_FLASH) && _findSlot(&updateStartAddress, &slotLen)) {
+        if (size > slotLen) {
+            _setError(UPDATE_ERROR_SPACE);
+            return false;
+        }
+        _slot = true;
+        _erasedTo = updateStartAddress;
+        // Only reachable as the selection if its check failed, but never boot it half written
         LittleFS.begin();
-        _fp = LittleFS.open("firmware.bin", "w+");
-        if (!_fp) {
+#ifdef _OTA_SLOT_FILE
+        picoOTA.clearBootSlot(updateStartAddress);
+#endif
 #ifdef DEBUG_UPDATER
-            DEBUG_UPDATER.println(F("[begin] unable to create file"));
+        DEBUG_UPDATER.printf_P(PSTR("[begin] Writing A/B slot at 0x%08X\n"), updateStartAddress);
 #endif
-            return false;
-        }
+    } else if (command == U_FLASH) {
+        LittleFS.begin();
         updateStartAddress = 0;  // Not used
     } else if (command == U_FS) {
         if (&_FS_start + size > &_FS_end) {
@@ -113,6 +173,7 @@ bool UpdaterClass::begin(size_t size, int command) {
         }
 
         updateStartAddress = (uint32_t)&_FS_start;
+        _erasedTo = updateStartAddress;
     } else {
         // unknown command
 #ifdef DEBUG_UPDATER
@@ -123,6 +184,7 @@ bool UpdaterClass::begin(size_t size, int command) {
 
     //initialize
     _startAddress = updateStartAddress;
+    _currentAddress = updateStartAddress;
     _size = size;
     _bufferSize = 4096;
     _buffer = new uint8_t[_bufferSize];
@@ -135,10 +197,85 @@ bool UpdaterClass::begin(size_t size, int command) {
 
     if (!_verify) {
         _md5.begin();
+    } else if (_slot && (_startAddress == XIP_BASE)) {
+        _hash->begin(); // The boot2/OTA prefix is hashed as it streams past, see _flashStep()
+    }
+
+    if (!_resume() && !_slot && (command == U_FLASH)) {
+        _fp = LittleFS.open("firmware.bin", "w+");
+        if (!_fp) {
+#ifdef DEBUG_UPDATER
+            DEBUG_UPDATER.println(F("[begin] unable to create file"));
+#endif
+            _reset();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Picks up a checkpointed U_FLASH update of the same image, see setResumeTag().  A checkpoint
+// for anything else is stale, since this update is about to overwrite its data.
+bool UpdaterClass::_resume() {
+    if (_command != U_FLASH) {
+        return false;
+    }
+    LittleFS.begin();
+    File f = LittleFS.open(UPDATER_RESUME_FILE, "r");
+    if (!f) {
+        return false;
+    }
+    UpdaterCheckpoint cp;
+    bool ok = _tag.length() && (f.size() == sizeof(cp) + _tag.length()) && (f.read((uint8_t *)&cp, sizeof(cp)) == sizeof(cp)) &&
+              (cp.magic == UPDATER_RESUME_MAGIC) && (cp.command == _command) && (cp.start == _startAddress) &&
+              (cp.size == _size) && (cp.done < _size) && !(cp.done % _bufferSize) &&
+              !(_verify && _slot && (_startAddress == XIP_BASE)); // The prefix's hash isn't saved
+    for (size_t i = 0; ok && (i < _tag.length()); i++) {
+        ok = (f.read() == _tag[i]);
+    }
+    f.close();
+    if (ok && !_slot) {
+        _fp = LittleFS.open("firmware.bin", "r+");
+        ok = _fp && (_fp.size() >= cp.done) && _fp.seek(cp.done);
+        if (!ok && _fp) {
+            _fp.close();
+        }
+    }
+    if (!ok) {
+        LittleFS.remove(UPDATER_RESUME_FILE);
+        return false;
+    }
+    _currentAddress = _startAddress + cp.done;
+    _erasedTo = _currentAddress;
+    if (!_verify) {
+        _md5.setState(cp.md5, cp.done);
     }
+#ifdef DEBUG_UPDATER
+    DEBUG_UPDATER.printf_P(PSTR("[begin] Resuming at %u\n"), cp.done);
+#endif
     return true;
 }
 
+// Records how much of a resumable U_FLASH update is in flash, and the MD5 up to there
+void UpdaterClass::_checkpoint() {
+    if (!_tag.length() || (_command != U_FLASH)) {
+        return;
+    }
+    if (!_slot) {
+        _fp.flush();
+    }
+    UpdaterCheckpoint cp = { UPDATER_RESUME_MAGIC, _command, _startAddress, (uint32_t)_size, (uint32_t)progress(), {} };
+    if (!_verify) {
+        _md5.getState(cp.md5);
+    }
+    File f = LittleFS.open(UPDATER_RESUME_FILE, "w");
+    if (f) {
+        f.write((const uint8_t *)&cp, sizeof(cp));
+        f.write((const uint8_t *)_tag.c_str(), _tag.length());
+        f.close();
+    }
+}
+
 bool UpdaterClass::setMD5(const char * expected_md5) {
     if (strlen(expected_md5) != 32) {
         return false;
@@ -176,6 +313,11 @@ bool UpdaterClass::end(bool evenIfRemaining) {
         _size = progress();
     }
 
+    // Complete, so nothing is left to resume whether or not the image checks out
+    if (_tag.length() && (_command == U_FLASH)) {
+        LittleFS.remove(UPDATER_RESUME_FILE);
+    }
+
     if (_verify && (_command == U_FLASH)) {
         const uint32_t expectedSigLen = _verify->length();
         // If expectedSigLen is non-zero, we expect the last four bytes of the buffer to
@@ -184,8 +326,7 @@ bool UpdaterClass::end(bool evenIfRemaining) {
         uint32_t sigLen = 0;
 
         if (expectedSigLen > 0) {
-            _fp.seek(_size - sizeof(uint32_t));
-            _fp.read((uint8_t *)&sigLen, sizeof(uint32_t));
+            _readImage(_size - sizeof(uint32_t), (uint8_t *)&sigLen, sizeof(uint32_t));
         }
 #ifdef DEBUG_UPDATER
         DEBUG_UPDATER.printf_P(PSTR("[Updater] sigLen: %d\n"), sigLen);
@@ -200,17 +341,37 @@ bool UpdaterClass::end(bool evenIfRemaining) {
         if (expectedSigLen > 0) {
             binSize -= (sigLen + sizeof(uint32_t) /* The siglen word */);
         }
-        _hash->begin();
+        int hashFrom = 0;
+        if (_slot && (_startAddress == XIP_BASE)) {
+            hashFrom = UPDATER_SLOT_VECTORS; // Already hashed, and not what's in flash
+        } else {
+            _hash->begin();
+        }
 #ifdef DEBUG_UPDATER
         DEBUG_UPDATER.printf_P(PSTR("[Updater] Adjusted binsize: %d\n"), binSize);
 #endif
-        // Calculate the MD5 and hash using proper size
-        uint8_t buff[128] __attribute__((aligned(4)));
-        _fp.seek(0);
-        for (int i = 0; i < binSize; i += sizeof(buff)) {
-            _fp.read(buff, sizeof(buff));
-            size_t read = std::min((int)sizeof(buff), binSize - i);
-            _hash->add(buff, read);
+        if (_slot) {
+            // Already memory mapped
+            _hash->add((const void *)(_startAddress + hashFrom), binSize - hashFrom);
+        } else {
+            // Calculate the MD5 and hash using proper size.  Large, word-aligned reads keep
+            // the filesystem overhead down and let the hash use its aligned fast path.
+            uint8_t smallBuff[128] __attribute__((aligned(4)));
+            int buffSize = 4096;
+            uint8_t *buff = (uint8_t *)malloc(buffSize);
+            if (!buff) {
+                buff = smallBuff;
+                buffSize = sizeof(smallBuff);
+            }
+            _fp.seek(0);
+            for (int i = 0; i < binSize; i += buffSize) {
+                _fp.read(buff, buffSize);
+                size_t read = std::min(buffSize, binSize - i);
+                _hash->add(buff, read);
+            }
+            if (buff != smallBuff) {
+                free(buff);
+            }
         }
         _hash->end();
 #ifdef DEBUG_UPDATER
@@ -230,8 +391,7 @@ bool UpdaterClass::end(bool evenIfRemaining) {
                 _reset();
                 return false;
             }
-            _fp.seek(_startAddress + binSize);
-            _fp.read((uint8_t *)sig, sigLen);
+            _readImage(binSize, sig, sigLen);
 #ifdef DEBUG_UPDATER
             DEBUG_UPDATER.printf_P(PSTR("[Updater] Received Signature:"));
             for (size_t i = 0; i < sigLen; i++) {
@@ -270,7 +430,12 @@ bool UpdaterClass::end(bool evenIfRemaining) {
         return false;
     }
 
-    if (_command == U_FLASH) {
+    if (_slot) {
+        if (!_commitSlot()) {
+            _reset();
+            return false;
+        }
+    } else if (_command == U_FLASH) {
         _fp.close();
         picoOTA.begin();
         picoOTA.addFile("firmware.bin");
@@ -284,24 +449,152 @@ bool UpdaterClass::end(bool evenIfRemaining) {
     return true;
 }
 
-bool UpdaterClass::_writeBuffer() {
-    if (_command == U_FLASH) {
-        if (_bufferLen != _fp.write(_buffer, _bufferLen)) {
+void UpdaterClass::_readImage(uint32_t offset, uint8_t *dst, size_t len) {
+    if (_slot) {
+        memcpy(dst, (const void *)(_startAddress + offset), len);
+    } else {
+        _fp.seek(offset);
+        _fp.read(dst, len);
+    }
+}
+
+// Does the next step of writing a padded sector at _currentAddress straight to flash (the A/B
+// slot or the filesystem): either erasing ahead of the write pointer, a block at a time, or
+// programming up to chunk bytes.  The boot2/OTA sectors at the start of slot A are what every
+// slot boots through, so a slot update never rewrites them.
+bool UpdaterClass::_flashStep(const uint8_t *data, size_t &pos, size_t chunk) {
+    uint32_t addr = _currentAddress;
+    if (_slot && (addr < XIP_BASE + UPDATER_SLOT_VECTORS)) {
+        if ((addr + _bufferSize == XIP_BASE + UPDATER_SLOT_VECTORS) && !_slotLayout((const uint32_t *)(data + _bufferSize - 16))) {
             return false;
         }
-    } else {
+        if (_verify) {
+            _hash->add(data, _bufferSize);
+        }
+        pos = _bufferSize;
+        return true;
+    }
+    if ((pos == 0) && (addr >= _erasedTo)) {
+        uint32_t end = (addr + UPDATER_ERASE_AHEAD) & ~(UPDATER_ERASE_AHEAD - 1);
+        end = std::min(end, (uint32_t)(_startAddress + _size + 4095) & ~4095u);
         noInterrupts();
         rp2040.idleOtherCore();
-        flash_range_erase((intptr_t)_currentAddress - (intptr_t)XIP_BASE, 4096);
-        flash_range_program((intptr_t)_currentAddress - (intptr_t)XIP_BASE, _buffer, 4096);
+        flash_range_erase(addr - XIP_BASE, end - addr);
         rp2040.resumeOtherCore();
         interrupts();
+        _erasedTo = end;
+        return true;
+    }
+    size_t len = std::min(chunk, _bufferSize - pos);
+    noInterrupts();
+    rp2040.idleOtherCore();
+    flash_range_program(addr + pos - XIP_BASE, data + pos, len);
+    rp2040.resumeOtherCore();
+    interrupts();
+    pos += len;
+    if ((pos == _bufferSize) && memcmp((const void *)addr, data, _bufferSize)) {
+        _setError(UPDATE_ERROR_WRITE);
+        return false;
+    }
+    return true;
+}
+
+// Checks an image's partition record (the 16 bytes before its vector table) against the
+// running flash layout
+bool UpdaterClass::_slotLayout(const uint32_t *part) {
+    if ((part[0] != (uint32_t)&_FS_start) || (part[1] != (uint32_t)&_FS_end) ||
+            (part[2] != (uint32_t)&_EEPROM_start) || (part[3] != (uint32_t)&_FLASH_length)) {
+#ifdef DEBUG_UPDATER
+        DEBUG_UPDATER.printf_P(PSTR("[Updater] Image not linked for this flash layout\n"));
+#endif
+        _setError(UPDATE_ERROR_MAGIC_BYTE);
+        return false;
+    }
+    return true;
+}
+
+// Checks the new image was linked for the slot and this flash layout, then has the OTA
+// shim boot it.  The selection is a LittleFS file, so a power failure while committing it
+// leaves either the old or new selection, and both slots hold complete images.
+bool UpdaterClass::_commitSlot() {
+    const uint32_t *part = (const uint32_t *)(_startAddress + UPDATER_SLOT_VECTORS - 16);
+    const uint32_t *vect = (const uint32_t *)(_startAddress + UPDATER_SLOT_VECTORS);
+    uint32_t end = _startAddress + (uint32_t)&_FLASH_length;
+    if (_size < UPDATER_SLOT_VECTORS + 8) {
+        _setError(UPDATE_ERROR_MAGIC_BYTE);
+        return false;
+    }
+    // Slot A's record was checked as it streamed past, flash holds the installed one
+    if ((_startAddress != XIP_BASE) && !_slotLayout(part)) {
+        return false;
+    }
+    if ((vect[1] < (uint32_t)vect) || (vect[1] >= end)) {
+#ifdef DEBUG_UPDATER
+        DEBUG_UPDATER.printf_P(PSTR("[Updater] Image not linked for the slot at 0x%08X\n"), _startAddress);
+#endif
+        _setError(UPDATE_ERROR_MAGIC_BYTE);
+        return false;
+    }
+    OTACRC32 crc;
+    crc.add((const void *)_startAddress, _size);
+    LittleFS.begin();
+#ifdef _OTA_SLOT_FILE
+    if (!picoOTA.setBootSlot(_startAddress, _size, crc.get())) {
+        _setError(UPDATE_ERROR_WRITE);
+        return false;
+    }
+#endif
+#ifdef DEBUG_UPDATER
+    DEBUG_UPDATER.printf_P(PSTR("Slot selected: address:0x%08X, size:0x%08zX\n"), _startAddress, _size);
+#endif
+    return true;
+}
+
+bool UpdaterClass::_writeBuffer() {
+    if (_rawFlash()) {
+        memset(_buffer + _bufferLen, 0xff, _bufferSize - _bufferLen);
+        size_t pos = 0;
+        while (pos < _bufferSize) {
+            if (!_flashStep(_buffer, pos, _bufferSize)) {
+                return false;
+            }
+        }
+    } else if (_bufferLen != _fp.write(_buffer, _bufferLen)) {
+        return false;
     }
     if (!_verify) {
         _md5.add(_buffer, _bufferLen);
     }
     _currentAddress += _bufferLen;
     _bufferLen = 0;
+    if (!(progress() % UPDATER_CHECKPOINT)) {
+        _checkpoint();
+    }
+    return true;
+}
+
+// One short piece of work on the writeStream() back buffer, so the stream can be drained again
+// soon.  Hashing is spread out the same way as programming.
+bool UpdaterClass::_backStep() {
+    if (!_verify && (_backHashed < _backLen)) {
+        size_t len = std::min((size_t)UPDATER_STEP, _backLen - _backHashed);
+        _md5.add(_back + _backHashed, len);
+        _backHashed += len;
+        return true;
+    }
+    if (!_flashStep(_back, _backPos, UPDATER_STEP)) {
+        return false;
+    }
+    if (_backPos == _bufferSize) {
+        _currentAddress += _backLen;
+        _backLen = 0;
+        if (!(progress() % UPDATER_CHECKPOINT)) {
+            _checkpoint();
+        }
+        if (_progress_callback) {
+            _progress_callback(progress(), _size);
+        }
+    }
     return true;
 }
 
@@ -367,33 +660,68 @@ size_t UpdaterClass::writeStream(Stream &data, uint16_t streamTimeout) {
     }
     esp8266::polledTimeout::oneShotMs timeOut(streamTimeout);
     if (_progress_callback) {
-        _progress_callback(0, _size);
+        _progress_callback(progress(), _size);
     }
 
-    while (remaining()) {
-        size_t bytesToRead = _bufferSize - _bufferLen;
-        if (bytesToRead > remaining()) {
-            bytesToRead = remaining();
+    // Raw flash is written from a second buffer, a step at a time, taking whatever the stream
+    // has already received in between.  This keeps data flowing instead of stalling the sender
+    // for every erase and program.  LittleFS files are written a buffer at a time, as before.
+    bool pipelined = _rawFlash();
+    if (pipelined && !_back) {
+        _back = new uint8_t[_bufferSize];
+    }
+    size_t left = remaining() - _bufferLen; // Still to be read from the stream
+    while (left || _bufferLen || _backLen) {
+        if (left && (_bufferLen < _bufferSize)) {
+            size_t bytesToRead = std::min(_bufferSize - _bufferLen, left);
+            if (_backLen) {
+                int avail = data.available();
+                bytesToRead = std::min(bytesToRead, (size_t)std::max(avail, 0));
+            }
+            toRead = bytesToRead ? data.readBytes(_buffer + _bufferLen, bytesToRead) : 0;
+            if (toRead) {
+                timeOut.reset();
+                _bufferLen += toRead;
+                left -= toRead;
+                written += toRead;
+            } else if (!_backLen) { //Timeout
+                if (timeOut && _tag.length()) {
+                    // Keep the update, from the last buffer written, for the caller to resume
+                    written -= _bufferLen;
+                    _bufferLen = 0;
+                    _checkpoint();
+                    return written;
+                } else if (timeOut) {
+                    _currentAddress = (_startAddress + _size);
+                    _setError(UPDATE_ERROR_STREAM);
+                    _reset();
+                    return written;
+                }
+                delay(100);
+            }
         }
-        toRead = data.readBytes(_buffer + _bufferLen,  bytesToRead);
-        if (toRead == 0) { //Timeout
-            if (timeOut) {
-                _currentAddress = (_startAddress + _size);
-                _setError(UPDATE_ERROR_STREAM);
-                _reset();
-                return written;
+        bool full = _bufferLen && ((_bufferLen == _bufferSize) || !left);
+        if (!pipelined) {
+            if (full) {
+                if (!_writeBuffer()) {
+                    return written;
+                }
+                if (_progress_callback) {
+                    _progress_callback(progress(), _size);
+                }
             }
-            delay(100);
         } else {
-            timeOut.reset();
-        }
-        _bufferLen += toRead;
-        if ((_bufferLen == remaining() || _bufferLen == _bufferSize) && !_writeBuffer()) {
-            return written;
-        }
-        written += toRead;
-        if (_progress_callback) {
-            _progress_callback(progress(), _size);
+            if (full && !_backLen) {
+                std::swap(_buffer, _back);
+                _backLen = _bufferLen;
+                _backPos = 0;
+                _backHashed = 0;
+                _bufferLen = 0;
+                memset(_back + _backLen, 0xff, _bufferSize - _backLen);
+            }
+            if (_backLen && !_backStep()) {
+                return written;
+            }
         }
         yield();
     }
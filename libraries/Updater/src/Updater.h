@@ -92,6 +92,18 @@ public:
         _async = async;
     }
 
+    /*
+        Lets an interrupted update carry on where it stopped, for example with an HTTP Range
+        request.  tag identifies the image (e.g. its ETag) and is set before begin().  Until
+        end(), writeStream() returns early on a stall instead of failing, and progress() is
+        where the data has to continue from.  U_FLASH updates are also checkpointed to
+        LittleFS, so a later begin() of the same tag, size and command resumes after a reset.
+        An empty tag turns this off.
+    */
+    void setResumeTag(const String &tag) {
+        _tag = tag;
+    }
+
     /*
         Writes a buffer to the flash and increments the address
         Returns the amount written
@@ -174,6 +186,15 @@ public:
         return _size - (_currentAddress - _startAddress);
     }
 
+    /*
+        True when this type of update is saved as a LittleFS file for the OTA bootloader to
+        copy into place, which lets the image be GZIP compressed
+    */
+    bool staged(int command = U_FLASH) {
+        uint32_t addr, len;
+        return (command == U_FLASH) && !_findSlot(&addr, &len);
+    }
+
     /*
         Template to write from objects that expose
         available() and read(uint8_t*, size_t) methods
@@ -222,6 +243,17 @@ public:
 private:
     void _reset();
     bool _writeBuffer();
+    bool _rawFlash() {
+        return _slot || (_command == U_FS);
+    }
+    bool _flashStep(const uint8_t *data, size_t &pos, size_t chunk);
+    bool _backStep();
+    void _checkpoint();
+    bool _resume();
+    bool _findSlot(uint32_t *addr, uint32_t *len);
+    bool _commitSlot();
+    bool _slotLayout(const uint32_t *part);
+    void _readImage(uint32_t offset, uint8_t *dst, size_t len);
 
     bool _verifyHeader(uint8_t data);
     bool _verifyEnd();
@@ -233,11 +265,19 @@ private:
     uint8_t *_buffer = nullptr;
     size_t _bufferLen = 0; // amount of data written into _buffer
     size_t _bufferSize = 0; // total size of _buffer
+    uint8_t *_back = nullptr; // writeStream() buffer being hashed and programmed while _buffer fills
+    size_t _backLen = 0;      // amount of data in _back, 0 once it is written
+    size_t _backPos = 0;      // amount of _back programmed
+    size_t _backHashed = 0;   // amount of _back added to the MD5
     size_t _size = 0;
     uint32_t _startAddress = 0;
     uint32_t _currentAddress = 0;
     uint32_t _command = U_FLASH;
     File _fp;
+    bool _slot = false;      // Streaming into the inactive A/B slot instead of LittleFS
+    uint32_t _erasedTo = 0;  // Raw flash is erased up to here
+
+    String _tag;             // Resumable update, see setResumeTag()
 
     String _target_md5;
     MD5Builder _md5;
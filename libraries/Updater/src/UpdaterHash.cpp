@@ -0,0 +1,214 @@
+/*
+    UpdaterHash.cpp - Fast hashes for the Updater signature and integrity checks
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "UpdaterHash.h"
+
+static const uint32_t _sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t _sha256IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// DER of OID 2.16.840.1.101.3.4.2.1, same as BearSSL's BR_HASH_OID_SHA256
+static const unsigned char _sha256OID[] = { 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01 };
+
+static inline uint32_t ror(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+#define SHA_S0(x)  (ror(x, 2) ^ ror(x, 13) ^ ror(x, 22))
+#define SHA_S1(x)  (ror(x, 6) ^ ror(x, 11) ^ ror(x, 25))
+#define SHA_s0(x)  (ror(x, 7) ^ ror(x, 18) ^ ((x) >> 3))
+#define SHA_s1(x)  (ror(x, 17) ^ ror(x, 19) ^ ((x) >> 10))
+#define SHA_CH(x, y, z)  (((x) & ((y) ^ (z))) ^ (z))
+#define SHA_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+// Only the 16 most recent schedule words are live, so W is a ring indexed mod 16
+#define SHA_SCHED(i) \
+    W[(i) & 15] += SHA_s1(W[((i) - 2) & 15]) + W[((i) - 7) & 15] + SHA_s0(W[((i) - 15) & 15])
+
+// Rather than shuffling a..h each round, the callers rotate the argument order
+#define SHA_ROUND(a, b, c, d, e, f, g, h, i) do { \
+        if ((i) >= 16) { \
+            SHA_SCHED(i); \
+        } \
+        uint32_t t1 = h + SHA_S1(e) + SHA_CH(e, f, g) + _sha256K[i] + W[(i) & 15]; \
+        uint32_t t2 = SHA_S0(a) + SHA_MAJ(a, b, c); \
+        d += t1; \
+        h = t1 + t2; \
+    } while (0)
+
+#define SHA_ROUND8(i) do { \
+        SHA_ROUND(a, b, c, d, e, f, g, h, (i) + 0); \
+        SHA_ROUND(h, a, b, c, d, e, f, g, (i) + 1); \
+        SHA_ROUND(g, h, a, b, c, d, e, f, (i) + 2); \
+        SHA_ROUND(f, g, h, a, b, c, d, e, (i) + 3); \
+        SHA_ROUND(e, f, g, h, a, b, c, d, (i) + 4); \
+        SHA_ROUND(d, e, f, g, h, a, b, c, (i) + 5); \
+        SHA_ROUND(c, d, e, f, g, h, a, b, (i) + 6); \
+        SHA_ROUND(b, c, d, e, f, g, h, a, (i) + 7); \
+    } while (0)
+
+void UpdaterSHA256::compress(uint32_t *state, const uint8_t *block) {
+    uint32_t W[16];
+    if (!((uintptr_t)block & 3)) {
+        // Aligned, single word loads and a REV each
+        const uint32_t *w = (const uint32_t *)__builtin_assume_aligned(block, 4);
+        for (int i = 0; i < 16; i++) {
+            W[i] = __builtin_bswap32(w[i]);
+        }
+    } else {
+        for (int i = 0; i < 16; i++) {
+            W[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) |
+                   ((uint32_t)block[4 * i + 2] << 8) | (uint32_t)block[4 * i + 3];
+        }
+    }
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    uint32_t f = state[5];
+    uint32_t g = state[6];
+    uint32_t h = state[7];
+
+    SHA_ROUND8(0);
+    SHA_ROUND8(8);
+    SHA_ROUND8(16);
+    SHA_ROUND8(24);
+    SHA_ROUND8(32);
+    SHA_ROUND8(40);
+    SHA_ROUND8(48);
+    SHA_ROUND8(56);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void UpdaterSHA256::begin() {
+    memcpy(_state, _sha256IV, sizeof(_state));
+    _count = 0;
+    memset(_sha256, 0, sizeof(_sha256));
+}
+
+void UpdaterSHA256::add(const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    size_t used = _count & 63;
+    _count += len;
+
+    if (used) {
+        size_t fill = std::min((size_t)(64 - used), (size_t)len);
+        memcpy(_buf + used, p, fill);
+        p += fill;
+        len -= fill;
+        if (used + fill < 64) {
+            return;
+        }
+        compress(_state, _buf);
+    }
+    // Full blocks straight from the caller's buffer, no copy
+    while (len >= 64) {
+        compress(_state, p);
+        p += 64;
+        len -= 64;
+    }
+    if (len) {
+        memcpy(_buf, p, len);
+    }
+}
+
+void UpdaterSHA256::end() {
+    uint64_t bits = _count * 8;
+    size_t used = _count & 63;
+    _buf[used++] = 0x80;
+    if (used > 56) {
+        memset(_buf + used, 0, 64 - used);
+        compress(_state, _buf);
+        used = 0;
+    }
+    memset(_buf + used, 0, 56 - used);
+    for (int i = 0; i < 8; i++) {
+        _buf[56 + i] = bits >> (56 - 8 * i);
+    }
+    compress(_state, _buf);
+    for (int i = 0; i < 8; i++) {
+        _sha256[4 * i + 0] = _state[i] >> 24;
+        _sha256[4 * i + 1] = _state[i] >> 16;
+        _sha256[4 * i + 2] = _state[i] >> 8;
+        _sha256[4 * i + 3] = _state[i];
+    }
+}
+
+int UpdaterSHA256::len() {
+    return sizeof(_sha256);
+}
+
+const void *UpdaterSHA256::hash() {
+    return (const void *)_sha256;
+}
+
+const unsigned char *UpdaterSHA256::oid() {
+    return _sha256OID;
+}
+
+
+void UpdaterCRC32::begin() {
+    _crc = OTACRC32();
+    memset(_out, 0, sizeof(_out));
+}
+
+void UpdaterCRC32::add(const void *data, uint32_t len) {
+    _crc.add(data, len);
+}
+
+void UpdaterCRC32::end() {
+    uint32_t v = _crc.get();
+    _out[0] = v >> 24;
+    _out[1] = v >> 16;
+    _out[2] = v >> 8;
+    _out[3] = v;
+}
+
+int UpdaterCRC32::len() {
+    return sizeof(_out);
+}
+
+const void *UpdaterCRC32::hash() {
+    return (const void *)_out;
+}
+
+const unsigned char *UpdaterCRC32::oid() {
+    return nullptr;
+}
@@ -0,0 +1,60 @@
+/*
+    UpdaterHash.h - Fast hashes for the Updater signature and integrity checks
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <Updater.h>
+#include <PicoOTA.h>
+
+// SHA-256 with a fully unrolled compression function.  Word-aligned input is loaded
+// a word at a time, everything else goes through a byte path.  Produces the same
+// digest and OID as BearSSL's SHA-256 so it can be used with SigningVerifier.
+class UpdaterSHA256 : public UpdaterHashClass {
+public:
+    virtual void begin() override;
+    virtual void add(const void *data, uint32_t len) override;
+    virtual void end() override;
+    virtual int len() override;
+    virtual const void *hash() override;
+    virtual const unsigned char *oid() override;
+
+protected:
+    static void compress(uint32_t *state, const uint8_t *block);
+
+    uint32_t _state[8];
+    uint64_t _count;
+    uint8_t _buf[64] __attribute__((aligned(4)));
+    unsigned char _sha256[32];
+};
+
+// Big-endian CRC32 (zlib polynomial) of the data, computed by the DMA sniffer when
+// possible.  Only useful for integrity checks, it has no OID and cannot be signed.
+class UpdaterCRC32 : public UpdaterHashClass {
+public:
+    virtual void begin() override;
+    virtual void add(const void *data, uint32_t len) override;
+    virtual void end() override;
+    virtual int len() override;
+    virtual const void *hash() override;
+    virtual const unsigned char *oid() override;
+
+protected:
+    OTACRC32 _crc;
+    uint8_t _out[4];
+};
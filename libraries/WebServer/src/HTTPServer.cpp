@@ -472,6 +472,22 @@ void HTTPServer::_streamFileCore(const size_t fileSize, const String & fileName,
     send(code, contentType, "");
 }
 
+size_t HTTPServer::_streamFileBody(fs::File &file) {
+    // Files which can be mapped go straight from flash to the network, skipping the copy
+    // through a RAM buffer, and whatever can't be mapped is sent the usual way
+    size_t sent = 0;
+    const uint8_t *data;
+    size_t len;
+    while ((len = file.mapRegion(&data, file.size() - file.position()))) {
+        size_t written = _currentClient->write(data, len);
+        sent += written;
+        if (written != len) {
+            return sent;
+        }
+    }
+    return sent + _currentClient->write(file);
+}
+
 String HTTPServer::pathArg(unsigned int i) {
     if (_currentHandler != nullptr) {
         return _currentHandler->pathArg(i);
@@ -180,7 +180,7 @@ public:
     template<typename T>
     size_t streamFile(T &file, const String& contentType, const int code = 200) {
         _streamFileCore(file.size(), file.name(), contentType, code);
-        return _currentClient->write(file);
+        return _streamFileBody(file);
     }
 
 protected:
@@ -204,6 +204,11 @@ protected:
     bool _collectHeader(const char* headerName, const char* headerValue);
 
     void _streamFileCore(const size_t fileSize, const String & fileName, const String & contentType, const int code = 200);
+    template<typename T>
+    size_t _streamFileBody(T &file) {
+        return _currentClient->write(file);
+    }
+    size_t _streamFileBody(fs::File &file);
 
     String _getRandomHexString();
     // for extracting Auth parameters
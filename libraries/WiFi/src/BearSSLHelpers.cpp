@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <Arduino.h>
+#include <CoreMutex.h>
 #include "StackThunk.h"
 
 #include <Updater_Signing.h>
@@ -877,48 +878,162 @@ bool X509List::append(const uint8_t *derCert, size_t derLen) {
     return true;
 }
 
-ServerSessions::~ServerSessions() {
-    if (_isDynamic && _store != nullptr) {
-        delete _store;
+void ClientSessionCache::setSize(uint32_t size) {
+    _size = size;
+    if (_entries.size() > _size) {
+        _evictions += _entries.size() - _size;
+        _entries.erase(_entries.begin(), _entries.begin() + (_entries.size() - _size));
     }
 }
 
-ServerSessions::ServerSessions(ServerSession *sessions, uint32_t size, bool isDynamic) :
-    _size(sessions != nullptr ? size : 0),
-    _store(sessions), _isDynamic(isDynamic) {
-    if (_size > 0) {
-        br_ssl_session_cache_lru_init(&_cache, (uint8_t*)_store, size * sizeof(ServerSession));
+bool ClientSessionCache::lookup(const uint8_t *key, br_ssl_session_parameters *params) {
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if (!memcmp(it->key, key, sizeof(it->key))) {
+            Entry e = *it;
+            *params = e.params;
+            // Move to the most recently used end
+            _entries.erase(it);
+            _entries.push_back(e);
+            return true;
+        }
     }
+    return false;
 }
 
-const br_ssl_session_cache_class **ServerSessions::getCache() {
-    return _size > 0 ? &_cache.vtable : nullptr;
+void ClientSessionCache::store(const uint8_t *key, const br_ssl_session_parameters *params, bool resumed) {
+    if (resumed) {
+        _hits++;
+    } else {
+        _misses++;
+    }
+    if (!_size) {
+        return;
+    }
+    remove(key);
+    if (!params->session_id_len) {
+        return; // Server doesn't support resumption
+    }
+    if (_entries.size() >= _size) {
+        _entries.erase(_entries.begin());
+        _evictions++;
+    }
+    Entry e;
+    memcpy(e.key, key, sizeof(e.key));
+    e.params = *params;
+    _entries.push_back(e);
 }
 
-// SHA256 hash for updater
-void HashSHA256::begin() {
-    br_sha256_init(&_cc);
-    memset(_sha256, 0, sizeof(_sha256));
+void ClientSessionCache::remove(const uint8_t *key) {
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if (!memcmp(it->key, key, sizeof(it->key))) {
+            _entries.erase(it);
+            return;
+        }
+    }
 }
 
-void HashSHA256::add(const void *data, uint32_t len) {
-    br_sha256_update(&_cc, data, len);
+ClientSessionCache TLSSessions;
+
+// Connections may be opened from either core
+auto_init_mutex(_tlsBufferMutex);
+
+bool TLSBufferPool::begin(size_t count, size_t size) {
+    CoreMutex m(&_tlsBufferMutex);
+    for (size_t i = 0; i < count; i++) {
+        unsigned char *buf = new (std::nothrow) unsigned char[size];
+        if (!buf) {
+            return false;
+        }
+        _slots.push_back({buf, size, false, false});
+    }
+    return true;
 }
 
-void HashSHA256::end() {
-    br_sha256_out(&_cc, _sha256);
+void TLSBufferPool::end() {
+    CoreMutex m(&_tlsBufferMutex);
+    for (auto it = _slots.begin(); it != _slots.end();) {
+        if (it->used) {
+            it->orphaned = true;
+            ++it;
+        } else {
+            delete[] it->buf;
+            it = _slots.erase(it);
+        }
+    }
 }
 
-int HashSHA256::len() {
-    return sizeof(_sha256);
+std::shared_ptr<unsigned char> TLSBufferPool::alloc(size_t size) {
+    {
+        CoreMutex m(&_tlsBufferMutex);
+        Slot *best = nullptr;
+        for (auto &s : _slots) {
+            if (!s.used && !s.orphaned && (s.size >= size) && (!best || (s.size < best->size))) {
+                best = &s;
+            }
+        }
+        if (best) {
+            best->used = true;
+            _stats.poolAllocs++;
+            _stats.slotsInUse++;
+            _stats.peakSlotsInUse = std::max(_stats.peakSlotsInUse, _stats.slotsInUse);
+            return std::shared_ptr<unsigned char>(best->buf, [this](unsigned char *buf) {
+                release(buf);
+            });
+        }
+    }
+    unsigned char *buf = new (std::nothrow) unsigned char[size];
+    if (!buf) {
+        return nullptr;
+    }
+    CoreMutex m(&_tlsBufferMutex);
+    _stats.heapAllocs++;
+    _stats.heapBytes += size;
+    _stats.peakHeapBytes = std::max(_stats.peakHeapBytes, _stats.heapBytes);
+    return std::shared_ptr<unsigned char>(buf, [this, size](unsigned char *buf) {
+        heapFree(buf, size);
+    });
+}
+
+void TLSBufferPool::release(unsigned char *buf) {
+    CoreMutex m(&_tlsBufferMutex);
+    for (auto it = _slots.begin(); it != _slots.end(); ++it) {
+        if (it->buf == buf) {
+            _stats.slotsInUse--;
+            if (it->orphaned) {
+                delete[] it->buf;
+                _slots.erase(it);
+            } else {
+                it->used = false;
+            }
+            return;
+        }
+    }
+}
+
+void TLSBufferPool::heapFree(unsigned char *buf, size_t size) {
+    delete[] buf;
+    CoreMutex m(&_tlsBufferMutex);
+    _stats.heapBytes -= size;
+}
+
+TLSBufferPool TLSBuffers;
+
+ServerSessions::~ServerSessions() {
+    if (_isDynamic && _store != nullptr) {
+        delete _store;
+    }
 }
 
-const void *HashSHA256::hash() {
-    return (const void*) _sha256;
+ServerSessions::ServerSessions(ServerSession *sessions, uint32_t size, bool isDynamic) :
+    _size(sessions != nullptr ? size : 0),
+    _store(sessions), _isDynamic(isDynamic) {
+    if (_size > 0) {
+        br_ssl_session_cache_lru_init(&_cache, (uint8_t*)_store, size * sizeof(ServerSession));
+    }
 }
 
-const unsigned char *HashSHA256::oid() {
-    return BR_HASH_OID_SHA256;
+const br_ssl_session_cache_class **ServerSessions::getCache() {
+    return _size > 0 ? &_cache.vtable : nullptr;
 }
 
 // SHA256 verifier
@@ -940,7 +1055,7 @@ extern "C" bool SigningVerifier_verify(PublicKey *_pubKey, UpdaterHashClass *has
     if (_pubKey->isRSA()) {
         bool ret;
         unsigned char vrf[hash->len()];
-        br_rsa_pkcs1_vrfy vrfy = br_rsa_pkcs1_vrfy_get_default();
+        br_rsa_pkcs1_vrfy vrfy = br_rsa_i15_pkcs1_vrfy; // i15/m15 suit the M0+ multiplier
         ret = vrfy((const unsigned char *)signature, signatureLen, hash->oid(), sizeof(vrf), _pubKey->getRSA(), vrf);
         if (!ret || memcmp(vrf, hash->hash(), sizeof(vrf))) {
             return false;
@@ -948,9 +1063,9 @@ extern "C" bool SigningVerifier_verify(PublicKey *_pubKey, UpdaterHashClass *has
             return true;
         }
     } else {
-        br_ecdsa_vrfy vrfy = br_ecdsa_vrfy_raw_get_default();
+        br_ecdsa_vrfy vrfy = br_ecdsa_i15_vrfy_raw;
         // The EC verifier actually does the compare, unlike the RSA one
-        return vrfy(br_ec_get_default(), hash->hash(), hash->len(), _pubKey->getEC(), (const unsigned char *)signature, signatureLen);
+        return vrfy(&br_ec_all_m15, hash->hash(), hash->len(), _pubKey->getEC(), (const unsigned char *)signature, signatureLen);
     }
 };
 
@@ -997,3 +1112,14 @@ make_stack_thunk_unsigned_char_ptr(br_ssl_engine_sendapp_buf, (const br_ssl_engi
 make_stack_thunk_void(br_ssl_engine_sendrec_ack, (br_ssl_engine_context *cc, size_t len), (cc, len));
 make_stack_thunk_unsigned_char_ptr(br_ssl_engine_sendrec_buf, (const br_ssl_engine_context *cc, size_t *len), (cc, len));
 #pragma GCC pop_options
+
+static void recvrec_ack_job(void *arg) {
+    thunk_recvrec_ack_job *job = (thunk_recvrec_ack_job *)arg;
+    br_ssl_engine_recvrec_ack(job->cc, job->len);
+}
+
+extern "C" void thunk_br_ssl_engine_recvrec_ack_post(thunk_recvrec_ack_job *job, br_ssl_engine_context *cc, size_t len) {
+    job->cc = cc;
+    job->len = len;
+    stack_thunk_offload_post(&job->job, recvrec_ack_job, job);
+}
@@ -25,7 +25,10 @@
 #include <Arduino.h>
 #include <bearssl/bearssl.h>
 #include <Updater.h>
+#include <UpdaterHash.h>
 #include <StackThunk.h>
+#include <memory>
+#include <vector>
 
 // Internal opaque structures, not needed by user applications
 namespace brssl {
@@ -154,6 +157,120 @@ private:
     br_ssl_session_parameters _session;
 };
 
+// Cache of client sessions, which WiFiClientSecure connections use once given one with
+// setSessionCache() (and no Session of their own with setSession()).  Sessions are keyed by a
+// SHA-256 of the host name (or IP), port and the contents of the connection's authentication
+// settings (trust anchors, fingerprint, known key, client certificate, etc.), so a session
+// established with e.g. setInsecure() or other trust anchors is never resumed by a connection
+// that would validate the server differently.  When full, the least recently used session is
+// dropped.  BearSSL only supports session ID resumption.
+class ClientSessionCache {
+    friend class WiFiClientSecureCtx;
+
+public:
+    ClientSessionCache(uint32_t size = 4) : _size(size) { }
+
+    // Set the maximum number of cached sessions, 0 disables the cache
+    void setSize(uint32_t size);
+    uint32_t size() {
+        return _size;
+    }
+    // Forget all cached sessions
+    void clear() {
+        _entries.clear();
+        _entries.shrink_to_fit();
+    }
+
+    // Handshakes which resumed a cached session
+    uint32_t hits() {
+        return _hits;
+    }
+    // Handshakes which had to do a full key exchange
+    uint32_t misses() {
+        return _misses;
+    }
+    // Sessions dropped to make room for new ones
+    uint32_t evictions() {
+        return _evictions;
+    }
+    void resetStats() {
+        _hits = _misses = _evictions = 0;
+    }
+
+private:
+    struct Entry {
+        uint8_t key[32];
+        br_ssl_session_parameters params;
+    };
+
+    bool lookup(const uint8_t *key, br_ssl_session_parameters *params);
+    void store(const uint8_t *key, const br_ssl_session_parameters *params, bool resumed);
+    void remove(const uint8_t *key);
+
+    uint32_t _size;
+    std::vector<Entry> _entries; // Most recently used last
+    uint32_t _hits = 0;
+    uint32_t _misses = 0;
+    uint32_t _evictions = 0;
+};
+
+// A shared cache for setSessionCache(&TLSSessions)
+extern ClientSessionCache TLSSessions;
+
+// Preallocated TLS I/O buffers.  Once slots have been added with begin(), WiFiClientSecure takes
+// its input and output buffers from here instead of the heap, so connect/close cycles don't
+// fragment memory and the worst case TLS memory use is reserved up front.  Each request gets
+// the smallest free slot that fits, or falls back to the heap if there is none.
+class TLSBufferPool {
+public:
+    struct Stats {
+        uint32_t poolAllocs;  // Buffers handed out from a slot
+        uint32_t heapAllocs;  // Buffers which had to come from the heap
+        uint32_t slotsInUse;  // Slots currently lent out
+        uint32_t peakSlotsInUse;
+        uint32_t heapBytes;   // Bytes of TLS buffers currently on the heap
+        uint32_t peakHeapBytes;
+    };
+
+    ~TLSBufferPool() {
+        end();
+    }
+
+    // Add count slots of size bytes each.  May be called several times to mix, e.g., 16K input
+    // slots with 512 byte output slots.  Sizes include the TLS record overhead, see setBufferSizes.
+    bool begin(size_t count, size_t size);
+    // Free all slots.  Ones still in use are freed when their connection closes.
+    void end();
+
+    std::shared_ptr<unsigned char> alloc(size_t size);
+
+    const Stats &stats() {
+        return _stats;
+    }
+    void resetStats() {
+        _stats.poolAllocs = _stats.heapAllocs = 0;
+        _stats.peakSlotsInUse = _stats.slotsInUse;
+        _stats.peakHeapBytes = _stats.heapBytes;
+    }
+
+private:
+    struct Slot {
+        unsigned char *buf;
+        size_t size;
+        bool used;
+        bool orphaned; // end() was called while lent out, free on return
+    };
+
+    void release(unsigned char *buf);
+    void heapFree(unsigned char *buf, size_t size);
+
+    std::vector<Slot> _slots;
+    Stats _stats = {};
+};
+
+// The pool WiFiClientSecure allocates from.  Empty (all heap) until TLSBuffers.begin() is called.
+extern TLSBufferPool TLSBuffers;
+
 // Represents a single server session.
 // Use with BearSSL::ServerSessions.
 typedef uint8_t ServerSession[100];
@@ -198,18 +315,9 @@ private:
 };
 
 
-// Updater SHA256 hash and signature verification
-class HashSHA256 : public UpdaterHashClass {
-public:
-    virtual void begin() override;
-    virtual void add(const void *data, uint32_t len) override;
-    virtual void end() override;
-    virtual int len() override;
-    virtual const void *hash() override;
-    virtual const unsigned char *oid() override;
-private:
-    br_sha256_context _cc;
-    unsigned char _sha256[32];
+// Updater SHA256 hash and signature verification, using the unrolled UpdaterSHA256 kernel
+// instead of BearSSL's generic one (the digest is identical)
+class HashSHA256 : public UpdaterSHA256 {
 };
 
 class SigningVerifier : public UpdaterVerifyClass {
@@ -242,3 +350,12 @@ extern "C" unsigned char *thunk_br_ssl_engine_sendapp_buf(const br_ssl_engine_co
 extern "C" void thunk_br_ssl_engine_sendapp_ack(br_ssl_engine_context *cc, size_t len);
 extern "C" unsigned char *thunk_br_ssl_engine_sendrec_buf(const br_ssl_engine_context *cc, size_t *len);
 extern "C" void thunk_br_ssl_engine_sendrec_ack(br_ssl_engine_context *cc, size_t len);
+
+// br_ssl_engine_recvrec_ack(), which decrypts a record once all of it has arrived, queued on
+// core 1 without waiting.  cc must not be touched until stack_thunk_offload_done(&job->job).
+typedef struct {
+    stack_thunk_job job;
+    br_ssl_engine_context *cc;
+    size_t len;
+} thunk_recvrec_ack_job;
+extern "C" void thunk_br_ssl_engine_recvrec_ack_post(thunk_recvrec_ack_job *job, br_ssl_engine_context *cc, size_t len);
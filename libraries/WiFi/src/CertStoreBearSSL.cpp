@@ -18,6 +18,7 @@
 */
 
 #include "CertStoreBearSSL.h"
+#include <algorithm>
 #include <memory>
 
 
@@ -38,9 +39,75 @@ extern "C" {
 }
 
 
+static const uint8_t _indexMagic[4] = { 'C', 'S', 'I', '2' };
+
 CertStore::~CertStore() {
     free(_indexName);
     free(_dataName);
+    for (auto &e : _cache) {
+        delete e.x509;
+    }
+    delete _x509;
+}
+
+void CertStore::setCacheSize(size_t entries) {
+    _cacheSize = entries;
+    _trimCache();
+}
+
+void CertStore::clearCache() {
+    size_t entries = _cacheSize;
+    _cacheSize = 0;
+    _trimCache();
+    _cacheSize = entries;
+}
+
+// Drop least recently used entries, skipping any BearSSL is still holding
+void CertStore::_trimCache() {
+    auto it = _cache.begin();
+    while ((_cache.size() > _cacheSize) && (it != _cache.end())) {
+        if (it->refs) {
+            ++it;
+        } else {
+            delete it->x509;
+            it = _cache.erase(it);
+        }
+    }
+}
+
+// Fingerprints the data file without decoding any certificates: its size, timestamp, and
+// every ar member header (name, date, and length).  Adding, removing, or replacing a
+// certificate changes the result.
+uint32_t CertStore::_hashDataFile(fs::File &data) {
+    uint32_t h = 2166136261UL;
+    auto mix = [&h](const void *buf, size_t len) {
+        const uint8_t *p = (const uint8_t *)buf;
+        while (len--) {
+            h = (h ^ *p++) * 16777619UL;
+        }
+    };
+    uint32_t size = data.size();
+    time_t mtime = data.getLastWrite();
+    mix(&size, sizeof(size));
+    mix(&mtime, sizeof(mtime));
+
+    uint32_t offset = 8; // "!<arch>\n"
+    while (offset + 60 <= size) {
+        uint8_t fileHeader[60];
+        int32_t length;
+        if (!data.seek(offset, fs::SeekSet) || (data.read(fileHeader, sizeof(fileHeader)) != sizeof(fileHeader))) {
+            break;
+        }
+        mix(fileHeader, sizeof(fileHeader));
+        fileHeader[58] = 0;
+        if (1 != sscanf((char *)(fileHeader + 48), "%ld", &length) || (length <= 0)) {
+            break;
+        }
+        offset += sizeof(fileHeader) + length;
+        offset += offset & 1;
+    }
+    data.seek(0, fs::SeekSet);
+    return h;
 }
 
 CertStore::CertInfo CertStore::_preprocessCert(uint32_t length, uint32_t offset, const void *raw) {
@@ -87,6 +154,7 @@ int CertStore::initCertStore(fs::FS &fs, const char *indexFileName, const char *
     uint32_t offset = 0;
 
     _fs = &fs;
+    _newGeneration();
 
     // In case initCertStore called multiple times, don't leak old filenames
     free(_indexName);
@@ -103,14 +171,11 @@ int CertStore::initCertStore(fs::FS &fs, const char *indexFileName, const char *
     memcpy_P(_indexName, indexFileName, strlen_P(indexFileName) + 1);
     memcpy_P(_dataName, dataFileName, strlen_P(dataFileName) + 1);
 
-    fs::File index = _fs->open(_indexName, "w");
-    if (!index) {
-        return 0;
-    }
+    clearCache();
+    _count = 0;
 
     fs::File data = _fs->open(_dataName, "r");
     if (!data) {
-        index.close();
         return 0;
     }
 
@@ -118,9 +183,29 @@ int CertStore::initCertStore(fs::FS &fs, const char *indexFileName, const char *
     if (data.read(magic, sizeof(magic)) != sizeof(magic) ||
             memcmp(magic, "!<arch>\n", sizeof(magic))) {
         data.close();
-        index.close();
         return 0;
     }
+
+    // Reuse the existing index if it was built from this exact data file
+    IndexHeader hdr;
+    uint32_t dataSize = data.size();
+    uint32_t dataHash = _hashDataFile(data);
+    fs::File index = _fs->open(_indexName, "r");
+    if (index) {
+        bool valid = (index.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)) &&
+                     !memcmp(hdr.magic, _indexMagic, sizeof(hdr.magic)) &&
+                     (hdr.dataSize == dataSize) && (hdr.dataHash == dataHash) &&
+                     (index.size() == sizeof(hdr) + hdr.count * sizeof(CertInfo));
+        index.close();
+        if (valid) {
+            data.close();
+            _count = hdr.count;
+            return _count;
+        }
+    }
+
+    std::vector<CertInfo> certs;
+    data.seek(sizeof(magic), fs::SeekSet);
     offset += sizeof(magic);
 
     while (true) {
@@ -148,12 +233,7 @@ int CertStore::initCertStore(fs::FS &fs, const char *indexFileName, const char *
 
         // If the filename starts with "//" then this is a rename file, skip it
         if (fileHeader[0] != '/' || fileHeader[1] != '/') {
-            CertStore::CertInfo ci = _preprocessCert(length, offset, raw);
-            if (index.write((uint8_t *)&ci, sizeof(ci)) != (ssize_t)sizeof(ci)) {
-                free(raw);
-                break;
-            }
-            count++;
+            certs.push_back(_preprocessCert(length, offset, raw));
         }
 
         offset += length;
@@ -165,7 +245,31 @@ int CertStore::initCertStore(fs::FS &fs, const char *indexFileName, const char *
         }
     }
     data.close();
+
+    // Sorted so findHashedTA can binary search the file instead of scanning it
+    std::sort(certs.begin(), certs.end(), [](const CertInfo & a, const CertInfo & b) {
+        return memcmp(a.sha256, b.sha256, sizeof(a.sha256)) < 0;
+    });
+
+    index = _fs->open(_indexName, "w");
+    if (!index) {
+        return 0;
+    }
+    memcpy(hdr.magic, _indexMagic, sizeof(hdr.magic));
+    hdr.count = 0;
+    hdr.dataSize = dataSize;
+    hdr.dataHash = dataHash;
+    size_t bytes = certs.size() * sizeof(CertInfo);
+    if ((index.write((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)) &&
+            (index.write((uint8_t *)certs.data(), bytes) == bytes)) {
+        // Only mark the index valid once every record is on disk
+        hdr.count = certs.size();
+        index.seek(0, fs::SeekSet);
+        index.write((uint8_t *)&hdr, sizeof(hdr));
+        count = hdr.count;
+    }
     index.close();
+    _count = count;
     return count;
 }
 
@@ -173,6 +277,37 @@ void CertStore::installCertStore(br_x509_minimal_context *ctx) {
     br_x509_minimal_set_dynamic(ctx, (void*)this, findHashedTA, freeHashedTA);
 }
 
+// Binary search of the sorted index, reading log2(count) records instead of all of them
+bool CertStore::_findCertInfo(const void *hashed_dn, CertInfo *ci) {
+    if (!_count) {
+        return false;
+    }
+    fs::File index = _fs->open(_indexName, "r");
+    if (!index) {
+        return false;
+    }
+    uint32_t lo = 0;
+    uint32_t hi = _count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (!index.seek(sizeof(IndexHeader) + mid * sizeof(CertInfo), fs::SeekSet) ||
+                (index.read((uint8_t *)ci, sizeof(*ci)) != sizeof(*ci))) {
+            break;
+        }
+        int cmp = memcmp(ci->sha256, hashed_dn, sizeof(ci->sha256));
+        if (!cmp) {
+            index.close();
+            return true;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    index.close();
+    return false;
+}
+
 const br_x509_trust_anchor *CertStore::findHashedTA(void *ctx, void *hashed_dn, size_t len) {
     CertStore *cs = static_cast<CertStore*>(ctx);
     CertStore::CertInfo ci;
@@ -181,54 +316,75 @@ const br_x509_trust_anchor *CertStore::findHashedTA(void *ctx, void *hashed_dn,
         return nullptr;
     }
 
-    fs::File index = cs->_fs->open(cs->_indexName, "r");
-    if (!index) {
-        return nullptr;
+    for (auto it = cs->_cache.begin(); it != cs->_cache.end(); ++it) {
+        if (!memcmp(it->sha256, hashed_dn, sizeof(it->sha256))) {
+            // Move to the most recently used end
+            std::rotate(it, it + 1, cs->_cache.end());
+            cs->_cache.back().refs++;
+            return cs->_cache.back().x509->getTrustAnchors();
+        }
     }
 
-    while (index.read((uint8_t *)&ci, sizeof(ci)) == sizeof(ci)) {
-        if (!memcmp(ci.sha256, hashed_dn, sizeof(ci.sha256))) {
-            index.close();
-            uint8_t *der = (uint8_t*)malloc(ci.length);
-            if (!der) {
-                return nullptr;
-            }
-            fs::File data = cs->_fs->open(cs->_dataName, "r");
-            if (!data) {
-                free(der);
-                return nullptr;
-            }
-            if (!data.seek(ci.offset, fs::SeekSet)) {
-                data.close();
-                free(der);
-                return nullptr;
-            }
-            if (data.read(der, ci.length) != (int)ci.length) {
-                free(der);
-                return nullptr;
-            }
-            data.close();
-            cs->_x509 = new (std::nothrow) X509List(der, ci.length);
-            free(der);
-            if (!cs->_x509) {
-                DEBUG_BSSL("CertStore::findHashedTA: OOM\n");
-                return nullptr;
-            }
+    if (!cs->_findCertInfo(hashed_dn, &ci)) {
+        return nullptr;
+    }
 
-            br_x509_trust_anchor *ta = (br_x509_trust_anchor*)cs->_x509->getTrustAnchors();
-            memcpy(ta->dn.data, ci.sha256, sizeof(ci.sha256));
-            ta->dn.len = sizeof(ci.sha256);
+    uint8_t *der = (uint8_t*)malloc(ci.length);
+    if (!der) {
+        return nullptr;
+    }
+    fs::File data = cs->_fs->open(cs->_dataName, "r");
+    if (!data) {
+        free(der);
+        return nullptr;
+    }
+    if (!data.seek(ci.offset, fs::SeekSet)) {
+        data.close();
+        free(der);
+        return nullptr;
+    }
+    if (data.read(der, ci.length) != (int)ci.length) {
+        free(der);
+        return nullptr;
+    }
+    data.close();
+    X509List *x509 = new (std::nothrow) X509List(der, ci.length);
+    free(der);
+    if (!x509) {
+        DEBUG_BSSL("CertStore::findHashedTA: OOM\n");
+        return nullptr;
+    }
 
-            return ta;
-        }
+    br_x509_trust_anchor *ta = (br_x509_trust_anchor*)x509->getTrustAnchors();
+    memcpy(ta->dn.data, ci.sha256, sizeof(ci.sha256));
+    ta->dn.len = sizeof(ci.sha256);
+
+    if (cs->_cacheSize) {
+        CacheEntry e;
+        memcpy(e.sha256, ci.sha256, sizeof(e.sha256));
+        e.x509 = x509;
+        e.refs = 1;
+        cs->_cache.push_back(e);
+        cs->_trimCache();
+    } else {
+        delete cs->_x509;
+        cs->_x509 = x509;
     }
-    index.close();
-    return nullptr;
+
+    return ta;
 }
 
 void CertStore::freeHashedTA(void *ctx, const br_x509_trust_anchor *ta) {
     CertStore *cs = static_cast<CertStore*>(ctx);
-    (void) ta; // Unused
+    for (auto &e : cs->_cache) {
+        if (e.x509->getTrustAnchors() == ta) {
+            if (e.refs) {
+                e.refs--;
+            }
+            cs->_trimCache();
+            return;
+        }
+    }
     delete cs->_x509;
     cs->_x509 = nullptr;
 }
@@ -24,6 +24,8 @@
 #include <bearssl/bearssl.h>
 #include <FS.h>
 
+#include <vector>
+
 // Base class for the certificate stores, which allow use
 // of a large set of certificates stored on FS or SD card to
 // be dynamically used when validating a X509 certificate
@@ -32,10 +34,29 @@ namespace BearSSL {
 
 class CertStoreBase {
 public:
+    CertStoreBase() {
+        _newGeneration();
+    }
     virtual ~CertStoreBase() {}
 
     // Installs the cert store into the X509 decoder (normally via static function callbacks)
     virtual void installCertStore(br_x509_minimal_context *ctx) = 0;
+
+    // Never reused by another store or by this one once its contents change, so TLS session
+    // caches can tell which set of trust anchors validated a session
+    uint32_t generation() const {
+        return _generation;
+    }
+
+protected:
+    // Stores must call this whenever the certificates they hold change
+    void _newGeneration() {
+        static uint32_t last = 0;
+        _generation = ++last;
+    }
+
+private:
+    uint32_t _generation;
 };
 
 class CertStore: public CertStoreBase {
@@ -43,23 +64,49 @@ public:
     CertStore() { };
     ~CertStore();
 
-    // Set the file interface instances, do preprocessing
+    // Set the file interface instances, do preprocessing.  The index is only rebuilt when
+    // the data file has changed since it was last written.
     int initCertStore(fs::FS &fs, const char *indexFileName, const char *dataFileName);
 
     // Installs the cert store into the X509 decoder (normally via static function callbacks)
     void installCertStore(br_x509_minimal_context *ctx);
 
+    // Keep up to this many decoded trust anchors in RAM (most recently used), 0 (default)
+    // decodes each one from the data file as needed
+    void setCacheSize(size_t entries);
+    void clearCache();
+
 protected:
     fs::FS *_fs = nullptr;
     char *_indexName = nullptr;
     char *_dataName = nullptr;
     X509List *_x509 = nullptr;
+    uint32_t _count = 0;
+
+    // Decoded trust anchors, most recently used last.  Entries lent to BearSSL (refs != 0)
+    // are never evicted until freeHashedTA returns them.
+    struct CacheEntry {
+        uint8_t sha256[32];
+        X509List *x509;
+        uint32_t refs;
+    };
+    std::vector<CacheEntry> _cache;
+    size_t _cacheSize = 0;
+    void _trimCache();
 
     // These need to be static as they are callbacks from BearSSL C code
     static const br_x509_trust_anchor *findHashedTA(void *ctx, void *hashed_dn, size_t len);
     static void freeHashedTA(void *ctx, const br_x509_trust_anchor *ta);
 
-    // The binary format of the index file
+    // The binary format of the index file: one IndexHeader followed by
+    // IndexHeader.count CertInfos sorted by sha256
+    class IndexHeader {
+    public:
+        uint8_t magic[4];
+        uint32_t count;
+        uint32_t dataSize;
+        uint32_t dataHash;
+    };
     class CertInfo {
     public:
         uint8_t sha256[32];
@@ -67,6 +114,8 @@ protected:
         uint32_t length;
     };
     static CertInfo _preprocessCert(uint32_t length, uint32_t offset, const void *raw);
+    static uint32_t _hashDataFile(fs::File &data);
+    bool _findCertInfo(const void *hashed_dn, CertInfo *ci);
 
 };
 
@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "StackThunk.h"
+#include <pico/util/queue.h>
+#include <hardware/sync.h>
 
 extern "C" {
 
@@ -105,4 +107,86 @@ extern "C" {
         return 4 * (_stackSize - cnt);
     }
 
+    /* Core 1 offload.  Callers queue a job and either spin until core 1 marks it done or
+       come back for it later.  Jobs run one at a time on the single thunk stack no matter
+       which core submitted them. */
+    static queue_t stack_thunk_jobs;
+    static volatile bool stack_thunk_jobs_ready = false;
+    static volatile bool stack_thunk_offload = false;
+
+    void stack_thunk_offload_begin() {
+        if (!stack_thunk_jobs_ready) {
+            queue_init(&stack_thunk_jobs, sizeof(stack_thunk_job *), 4);
+            stack_thunk_jobs_ready = true;
+        }
+        stack_thunk_offload = true;
+    }
+
+    void stack_thunk_offload_end() {
+        /* Let anything already queued drain before core 0 goes back to running locally */
+        stack_thunk_offload = false;
+        while (stack_thunk_jobs_ready && !queue_is_empty(&stack_thunk_jobs)) {
+            tight_loop_contents();
+        }
+    }
+
+    bool stack_thunk_offload_wanted() {
+        /* Core 1 runs its own calls directly, it can't wait on itself */
+        return stack_thunk_offload && (get_core_num() != 1);
+    }
+
+    void stack_thunk_offload_post(stack_thunk_job *job, stack_thunk_job_fn fn, void *arg) {
+        job->fn = fn;
+        job->arg = arg;
+        job->done = false;
+        queue_add_blocking(&stack_thunk_jobs, &job);
+    }
+
+    bool stack_thunk_offload_done(const stack_thunk_job *job) {
+        if (!job->done) {
+            return false;
+        }
+        __dmb(); /* Everything the job wrote is visible once done is */
+        return true;
+    }
+
+    void stack_thunk_offload_wait(const stack_thunk_job *job) {
+        while (!stack_thunk_offload_done(job)) {
+            tight_loop_contents();
+        }
+    }
+
+    void stack_thunk_offload_run(stack_thunk_job_fn fn, void *arg) {
+        stack_thunk_job job;
+        stack_thunk_offload_post(&job, fn, arg);
+        stack_thunk_offload_wait(&job);
+    }
+
+    static void stack_thunk_run_job(stack_thunk_job *job) {
+        register uint32_t* sp asm("sp");
+        stack_thunk_save = sp;
+        sp = stack_thunk_top;
+        job->fn(job->arg);
+        sp = stack_thunk_save;
+    }
+
+    bool stack_thunk_offload_service() {
+        stack_thunk_job *job;
+        if (!stack_thunk_jobs_ready || !queue_try_remove(&stack_thunk_jobs, &job)) {
+            return false;
+        }
+        stack_thunk_run_job(job);
+        __dmb();
+        job->done = true;
+        return true;
+    }
+
+    void stack_thunk_offload_loop() {
+        while (true) {
+            if (!stack_thunk_offload_service()) {
+                tight_loop_contents();
+            }
+        }
+    }
+
 };
@@ -43,8 +43,34 @@ extern uint32_t *stack_thunk_top;
 extern uint32_t *stack_thunk_save;
 extern uint32_t stack_thunk_refcnt;
 
+// Optionally run every thunked call (i.e. all BearSSL record and handshake crypto) on core 1.
+// Once begun, core 1 must call stack_thunk_offload_service() from loop1() or sit in
+// stack_thunk_offload_loop(), or callers on core 0 will wait forever.
+typedef void (*stack_thunk_job_fn)(void *arg);
+typedef struct {
+    stack_thunk_job_fn fn;
+    void *arg;
+    volatile bool done;
+} stack_thunk_job;
+extern void stack_thunk_offload_begin();
+extern void stack_thunk_offload_end();
+extern bool stack_thunk_offload_service();
+extern void stack_thunk_offload_loop();
+extern bool stack_thunk_offload_wanted();
+extern void stack_thunk_offload_run(stack_thunk_job_fn fn, void *arg);
+// Queues a job for core 1 and returns at once, so the caller can get on with other work.
+// The job must stay in place until stack_thunk_offload_done() or _wait() says it has run.
+extern void stack_thunk_offload_post(stack_thunk_job *job, stack_thunk_job_fn fn, void *arg);
+extern bool stack_thunk_offload_done(const stack_thunk_job *job);
+extern void stack_thunk_offload_wait(const stack_thunk_job *job);
+
 #define make_stack_thunk_void(fcnToThunk, proto, params) \
 extern "C" void thunk_##fcnToThunk proto { \
+    if (stack_thunk_offload_wanted()) { \
+        auto job = [&]() { fcnToThunk params; }; \
+        stack_thunk_offload_run(stack_thunk_job_call<decltype(job)>, &job); \
+        return; \
+    } \
     register uint32_t* sp asm("sp"); \
     stack_thunk_save = sp; \
     sp = stack_thunk_top; \
@@ -54,6 +80,12 @@ extern "C" void thunk_##fcnToThunk proto { \
 
 #define make_stack_thunk_unsigned_char_ptr(fcnToThunk, proto, params) \
 extern "C" unsigned char * thunk_##fcnToThunk proto { \
+    if (stack_thunk_offload_wanted()) { \
+        unsigned char *x; \
+        auto job = [&]() { x = fcnToThunk params; }; \
+        stack_thunk_offload_run(stack_thunk_job_call<decltype(job)>, &job); \
+        return x; \
+    } \
     register uint32_t* sp asm("sp"); \
     stack_thunk_save = sp; \
     sp = stack_thunk_top; \
@@ -64,6 +96,12 @@ extern "C" unsigned char * thunk_##fcnToThunk proto { \
 
 #define make_stack_thunk_bool(fcnToThunk, proto, params) \
 extern "C" bool thunk_##fcnToThunk proto { \
+    if (stack_thunk_offload_wanted()) { \
+        bool x; \
+        auto job = [&]() { x = fcnToThunk params; }; \
+        stack_thunk_offload_run(stack_thunk_job_call<decltype(job)>, &job); \
+        return x; \
+    } \
     register uint32_t* sp asm("sp"); \
     stack_thunk_save = sp; \
     sp = stack_thunk_top; \
@@ -75,3 +113,10 @@ extern "C" bool thunk_##fcnToThunk proto { \
 #ifdef __cplusplus
 }
 #endif
+
+#ifdef __cplusplus
+// Trampoline from the C job interface to the lambdas built by the thunk macros
+template<typename T> void stack_thunk_job_call(void *job) {
+    (*(T *)job)();
+}
+#endif
@@ -381,27 +381,24 @@ uint8_t WiFiClient::getKeepAliveCount() const {
     return _client->getKeepAliveCount();
 }
 
-//bool WiFiClient::hasPeekBufferAPI () const
-//{
-//    return true;
-//}
+bool WiFiClient::hasPeekBufferAPI() const {
+    return true;
+}
 
 // return a pointer to available data buffer (size = peekAvailable())
 // semantic forbids any kind of read() before calling peekConsume()
-//const char* WiFiClient::peekBuffer ()
-//{
-//    return _client? _client->peekBuffer(): nullptr;
-//}
+const char* WiFiClient::peekBuffer() {
+    return _client ? _client->peekBuffer() : nullptr;
+}
 
 // return number of byte accessible by peekBuffer()
-//size_t WiFiClient::peekAvailable ()
-//{
-//    return _client? _client->peekAvailable(): 0;
-//}
+size_t WiFiClient::peekAvailable() {
+    return _client ? _client->peekAvailable() : 0;
+}
 
 // consume bytes after use (see peekBuffer)
-//void WiFiClient::peekConsume (size_t consume)
-//{
-//    if (_client)
-//        _client->peekConsume(consume);
-//}
+void WiFiClient::peekConsume(size_t consume) {
+    if (_client) {
+        _client->peekConsume(consume);
+    }
+}
@@ -139,17 +139,17 @@ public:
     void setSync(bool sync);
 
     // peek buffer API is present
-    //virtual bool hasPeekBufferAPI () const override;
+    virtual bool hasPeekBufferAPI() const;
 
     // return number of byte accessible by peekBuffer()
-    //virtual size_t peekAvailable () override;
+    virtual size_t peekAvailable();
 
     // return a pointer to available data buffer (size = peekAvailable())
     // semantic forbids any kind of read() before calling peekConsume()
-    //virtual const char* peekBuffer () override;
+    virtual const char* peekBuffer();
 
     // consume bytes after use (see peekBuffer)
-    //virtual void peekConsume (size_t consume) override;
+    virtual void peekConsume(size_t consume);
 
     //virtual bool outputCanTimeout () override { return connected(); }
     //virtual bool inputCanTimeout () override { return connected(); }
@@ -85,8 +85,10 @@ void WiFiClientSecureCtx::_clear() {
     _handshake_done = false;
     _recvapp_buf = nullptr;
     _recvapp_len = 0;
+    _recvBusy = false;
     _oom_err = false;
     _session = nullptr;
+    _sessionCache = nullptr;
     _cipher_list = nullptr;
     _cipher_cnt = 0;
     _tls_min = BR_TLS10;
@@ -215,6 +217,7 @@ void WiFiClientSecureCtx::setBufferSizes(int recv, int xmit) {
 }
 
 bool WiFiClientSecureCtx::stop(unsigned int maxWaitMs) {
+    _recvWait();
     bool ret = WiFiClient::stop(maxWaitMs); // calls our virtual flush()
     // Only if we've already connected, store session params and clear the connection options
     if (_handshake_done) {
@@ -256,6 +259,8 @@ int WiFiClientSecureCtx::connect(const String& host, uint16_t port) {
 }
 
 void WiFiClientSecureCtx::_freeSSL() {
+    // Core 1 may still be writing into the buffers
+    _recvWait();
     // These are smart pointers and will free if refcnt==0
     _sc = nullptr;
     _sc_svr = nullptr;
@@ -276,8 +281,23 @@ bool WiFiClientSecureCtx::_clientConnected() {
     return (_client && _client->state() == ESTABLISHED);
 }
 
+bool WiFiClientSecureCtx::_recvPending() {
+    if (_recvBusy && stack_thunk_offload_done(&_recvJob.job)) {
+        _recvBusy = false;
+    }
+    return _recvBusy;
+}
+
+void WiFiClientSecureCtx::_recvWait() {
+    if (_recvBusy) {
+        stack_thunk_offload_wait(&_recvJob.job);
+        _recvBusy = false;
+    }
+}
+
 uint8_t WiFiClientSecureCtx::connected() {
-    if (available() || (_clientConnected() && _handshake_done && (br_ssl_engine_current_state(_eng) != BR_SSL_CLOSED))) {
+    // A record still being decrypted can't have closed the engine yet
+    if (available() || (_clientConnected() && _handshake_done && (_recvBusy || (br_ssl_engine_current_state(_eng) != BR_SSL_CLOSED)))) {
         return true;
     }
     return false;
@@ -392,7 +412,7 @@ int WiFiClientSecureCtx::read(uint8_t *buf, size_t size) {
     }
     return 0; // If we're connected, no error but no read.
 }
-#if 0
+
 // return a pointer to available data buffer (size = peekAvailable())
 // semantic forbids any kind of read() before calling peekConsume()
 const char* WiFiClientSecureCtx::peekBuffer() {
@@ -406,7 +426,7 @@ void WiFiClientSecureCtx::peekConsume(size_t consume) {
     _recvapp_buf = nullptr;
     _recvapp_len = 0;
 }
-#endif
+
 int WiFiClientSecureCtx::read() {
     uint8_t c;
     if (1 == read(&c, 1)) {
@@ -420,6 +440,9 @@ int WiFiClientSecureCtx::available() {
     if (_recvapp_buf) {
         return _recvapp_len;  // Anything from last call?
     }
+    if (_recvPending()) {
+        return 0;  // Core 1 is still decrypting, check back later
+    }
     _recvapp_buf = nullptr;
     _recvapp_len = 0;
     if (!ctx_present() || _run_until(BR_SSL_RECVAPP, false) < 0) {
@@ -477,6 +500,7 @@ int WiFiClientSecureCtx::_run_until(unsigned target, bool blocking) {
         DEBUG_BSSL("_run_until: Not connected\n");
         return -1;
     }
+    _recvWait();
 
     uint32_t start = millis();
     //  esp8266::polledTimeout::oneShotMs loopTimeout(_timeout);
@@ -574,6 +598,13 @@ int WiFiClientSecureCtx::_run_until(unsigned target, bool blocking) {
                 if (rlen < 0) {
                     return -1;
                 }
+                if ((rlen > 0) && !blocking && stack_thunk_offload_wanted()) {
+                    // Hand the record to core 1 and let available() collect the result, so
+                    // the caller can overlap its own work with the decryption
+                    thunk_br_ssl_engine_recvrec_ack_post(&_recvJob, _eng, rlen);
+                    _recvBusy = true;
+                    return -1;
+                }
                 if (rlen > 0) {
                     br_ssl_engine_recvrec_ack(_eng, rlen);
                 }
@@ -968,6 +999,19 @@ extern "C" {
         br_x509_minimal_set_hash(x509, br_sha512_ID, &br_sha512_vtable);
     }
 
+    // The RP2040's Cortex-M0+ only has a 32x32->32 multiplier.  BearSSL's "default" public key
+    // code for 32-bit targets is the i31/m31 family, whose 32x32->64 products all become
+    // __aeabi_lmul calls here.  The i15/m15 family is written for multiplier-limited cores like
+    // this one (P-256 and Curve25519 field math in 15-bit limbs, with a precomputed fixed-base
+    // table for key generation) and is much faster, so always use it.
+    static void br_ssl_engine_install_m0_pk(br_ssl_engine_context *eng) {
+        br_ssl_engine_set_rsavrfy(eng, br_rsa_i15_pkcs1_vrfy);
+#ifndef BEARSSL_SSL_BASIC
+        br_ssl_engine_set_ec(eng, &br_ec_all_m15);
+        br_ssl_engine_set_ecdsa(eng, br_ecdsa_i15_vrfy_asn1);
+#endif
+    }
+
     // Default initializion for our SSL clients
     static void br_ssl_client_base_init(br_ssl_client_context *cc, const uint16_t *cipher_list, int cipher_cnt) {
         uint16_t suites[cipher_cnt];
@@ -976,11 +1020,8 @@ extern "C" {
         br_ssl_engine_add_flags(&cc->eng, BR_OPT_NO_RENEGOTIATION);  // forbid SSL renegotiation, as we free the Private Key after handshake
         br_ssl_engine_set_versions(&cc->eng, BR_TLS10, BR_TLS12);
         br_ssl_engine_set_suites(&cc->eng, suites, (sizeof suites) / (sizeof suites[0]));
-        br_ssl_client_set_default_rsapub(cc);
-        br_ssl_engine_set_default_rsavrfy(&cc->eng);
-#ifndef BEARSSL_SSL_BASIC
-        br_ssl_engine_set_default_ecdsa(&cc->eng);
-#endif
+        br_ssl_client_set_rsapub(cc, br_rsa_i15_public);
+        br_ssl_engine_install_m0_pk(&cc->eng);
         br_ssl_client_install_hashes(&cc->eng);
         br_ssl_engine_set_prf10(&cc->eng, &br_tls10_prf);
         br_ssl_engine_set_prf_sha256(&cc->eng, &br_tls12_sha256_prf);
@@ -1002,9 +1043,7 @@ extern "C" {
         br_ssl_engine_add_flags(&cc->eng, BR_OPT_NO_RENEGOTIATION);  // forbid SSL renegotiation, as we free the Private Key after handshake
         br_ssl_engine_set_versions(&cc->eng, BR_TLS10, BR_TLS12);
         br_ssl_engine_set_suites(&cc->eng, suites, (sizeof suites) / (sizeof suites[0]));
-#ifndef BEARSSL_SSL_BASIC
-        br_ssl_engine_set_default_ec(&cc->eng);
-#endif
+        br_ssl_engine_install_m0_pk(&cc->eng);
 
         br_ssl_client_install_hashes(&cc->eng);
         br_ssl_engine_set_prf10(&cc->eng, &br_tls10_prf);
@@ -1114,14 +1153,106 @@ bool WiFiClientSecureCtx::_installClientX509Validator() {
 }
 
 std::shared_ptr<unsigned char> WiFiClientSecureCtx::_alloc_iobuf(size_t sz) {
-    // Allocate buffer with preference to IRAM
-    //  HeapSelectIram primary;
-    auto sptr = std::shared_ptr<unsigned char>(new (std::nothrow) unsigned char[sz], std::default_delete<unsigned char[]>());
-    if (!sptr) {
-        //    HeapSelectDram alternate;
-        sptr = std::shared_ptr<unsigned char>(new (std::nothrow) unsigned char[sz], std::default_delete<unsigned char[]>());
-    }
-    return sptr;
+    // Comes from the preallocated TLSBuffers slots if configured, else the heap
+    return TLSBuffers.alloc(sz);
+}
+
+// Length prefixed, so that neighbouring fields can't run into each other
+static void _hashBlob(br_sha256_context *sha, const void *data, size_t len) {
+    uint32_t l = data ? len : 0xffffffff;
+    br_sha256_update(sha, &l, sizeof(l));
+    if (data) {
+        br_sha256_update(sha, data, len);
+    }
+}
+
+static void _hashRSA(br_sha256_context *sha, const br_rsa_public_key *rsa) {
+    _hashBlob(sha, rsa->n, rsa->nlen);
+    _hashBlob(sha, rsa->e, rsa->elen);
+}
+
+static void _hashEC(br_sha256_context *sha, const br_ec_public_key *ec) {
+    _hashBlob(sha, &ec->curve, sizeof(ec->curve));
+    _hashBlob(sha, ec->q, ec->qlen);
+}
+
+// Trust anchors by content, so a list edited in place or reallocated at the same address differs
+static void _hashTrustAnchors(br_sha256_context *sha, const X509List *list) {
+    uint32_t count = list ? list->getCount() : 0;
+    _hashBlob(sha, &count, sizeof(count));
+    for (uint32_t i = 0; i < count; i++) {
+        const br_x509_trust_anchor *ta = &list->getTrustAnchors()[i];
+        _hashBlob(sha, ta->dn.data, ta->dn.len);
+        _hashBlob(sha, &ta->flags, sizeof(ta->flags));
+        _hashBlob(sha, &ta->pkey.key_type, sizeof(ta->pkey.key_type));
+        if (ta->pkey.key_type == BR_KEYTYPE_RSA) {
+            _hashRSA(sha, &ta->pkey.key.rsa);
+        } else {
+            _hashEC(sha, &ta->pkey.key.ec);
+        }
+    }
+}
+
+static void _hashCerts(br_sha256_context *sha, const X509List *list) {
+    uint32_t count = list ? list->getCount() : 0;
+    _hashBlob(sha, &count, sizeof(count));
+    for (uint32_t i = 0; i < count; i++) {
+        _hashBlob(sha, list->getX509Certs()[i].data, list->getX509Certs()[i].data_len);
+    }
+}
+
+// Everything that decides how the server is authenticated and how we authenticate to it
+void WiFiClientSecureCtx::_hashAuthSettings(br_sha256_context *sha) {
+    const uint32_t flags[] = { _use_insecure, _use_self_signed, _use_fingerprint, _knownkey_usages, _tls_min, _tls_max };
+    _hashBlob(sha, flags, sizeof(flags));
+    if (_use_fingerprint) {
+        _hashBlob(sha, _fingerprint, sizeof(_fingerprint));
+    }
+    _hashTrustAnchors(sha, _ta);
+    _hashTrustAnchors(sha, _esp32_ta);
+    // A CertStore reads its certificates from a file, so it is identified by a generation
+    // number which changes every time it is (re)initialized rather than by its contents
+    uint32_t store = _certStore ? _certStore->generation() : 0;
+    _hashBlob(sha, &store, sizeof(store));
+    if (_knownkey && _knownkey->isRSA()) {
+        _hashRSA(sha, _knownkey->getRSA());
+    } else if (_knownkey && _knownkey->isEC()) {
+        _hashEC(sha, _knownkey->getEC());
+    } else {
+        _hashBlob(sha, nullptr, 0);
+    }
+    // The client certificate identifies us, its key has to match it
+    _hashCerts(sha, _chain);
+    _hashCerts(sha, _esp32_chain);
+    const uint32_t keys[] = { _sk != nullptr, _esp32_sk != nullptr };
+    _hashBlob(sha, keys, sizeof(keys));
+    _hashBlob(sha, _cipher_list.get(), _cipher_cnt * sizeof(uint16_t));
+}
+
+void WiFiClientSecureCtx::getAuthSettingsHash(uint8_t hash[32]) {
+    br_sha256_context sha;
+    br_sha256_init(&sha);
+    _hashAuthSettings(&sha);
+    br_sha256_out(&sha, hash);
+}
+
+// Build the session cache key from the peer and everything that affects how it is authenticated
+void WiFiClientSecureCtx::_sessionCacheKey(const char *hostName, uint8_t key[32]) {
+    br_sha256_context sha;
+    br_sha256_init(&sha);
+    String ip;
+    if (!hostName) {
+        ip = remoteIP().toString();
+        hostName = ip.c_str();
+    }
+    for (const char *p = hostName; *p; p++) {
+        char c = tolower(*p);
+        br_sha256_update(&sha, &c, 1);
+    }
+    uint16_t port = remotePort();
+    _hashBlob(&sha, &port, sizeof(port));
+    _hashAuthSettings(&sha);
+    br_sha256_out(&sha, key);
 }
 
 // Called by connect() to do the actual SSL setup and handshake.
@@ -1181,12 +1312,12 @@ bool WiFiClientSecureCtx::_connectSSL(const char* hostName) {
     // Apply any client certificates, if supplied.
     if (_sk && _sk->isRSA()) {
         br_ssl_client_set_single_rsa(_sc.get(), _chain ? _chain->getX509Certs() : nullptr, _chain ? _chain->getCount() : 0,
-                                     _sk->getRSA(), br_rsa_pkcs1_sign_get_default());
+                                     _sk->getRSA(), br_rsa_i15_pkcs1_sign);
     } else if (_sk && _sk->isEC()) {
 #ifndef BEARSSL_SSL_BASIC
         br_ssl_client_set_single_ec(_sc.get(), _chain ? _chain->getX509Certs() : nullptr, _chain ? _chain->getCount() : 0,
                                     _sk->getEC(), _allowed_usages,
-                                    _cert_issuer_key_type, br_ec_get_default(), br_ecdsa_sign_asn1_get_default());
+                                    _cert_issuer_key_type, &br_ec_all_m15, br_ecdsa_i15_sign_asn1);
 #else
         _freeSSL();
         DEBUG_BSSL("_connectSSL: Attempting to use EC cert in minimal cipher mode (no EC)\n");
@@ -1194,21 +1325,47 @@ bool WiFiClientSecureCtx::_connectSSL(const char* hostName) {
 #endif
     } else if (_esp32_sk && _esp32_chain) {
         br_ssl_client_set_single_rsa(_sc.get(), _esp32_chain->getX509Certs(), _esp32_chain->getCount(),
-                                     _esp32_sk->getRSA(), br_rsa_pkcs1_sign_get_default());
+                                     _esp32_sk->getRSA(), br_rsa_i15_pkcs1_sign);
     }
 
-    // Restore session from the storage spot, if present
+    // Restore session from the storage spot, if present, or else from the shared cache
+    bool resume = false;
+    br_ssl_session_parameters cached;
+    cached.session_id_len = 0;
+    uint8_t cacheKey[32];
     if (_session) {
         br_ssl_engine_set_session_parameters(_eng, _session->getSession());
+        resume = true;
+    } else if (_sessionCache) {
+        _sessionCacheKey(hostName, cacheKey);
+        if (_sessionCache->lookup(cacheKey, &cached)) {
+            DEBUG_BSSL("_connectSSL: Trying cached session\n");
+            br_ssl_engine_set_session_parameters(_eng, &cached);
+            resume = true;
+        }
     }
 
-    if (!br_ssl_client_reset(_sc.get(), hostName, _session ? 1 : 0)) {
+    if (!br_ssl_client_reset(_sc.get(), hostName, resume ? 1 : 0)) {
         _freeSSL();
         DEBUG_BSSL("_connectSSL: Can't reset client\n");
         return false;
     }
 
     auto ret = _wait_for_handshake();
+
+    if (!_session && _sessionCache) {
+        if (ret) {
+            // The server resumed if it echoed back the session ID we offered
+            br_ssl_session_parameters params;
+            br_ssl_engine_get_session_parameters(_eng, &params);
+            bool resumed = cached.session_id_len && (cached.session_id_len == params.session_id_len) &&
+                           !memcmp(cached.session_id, params.session_id, params.session_id_len);
+            DEBUG_BSSL("_connectSSL: Session %s\n", resumed ? "resumed" : "negotiated");
+            _sessionCache->store(cacheKey, &params, resumed);
+        } else {
+            _sessionCache->remove(cacheKey);
+        }
+    }
 #ifdef DEBUG_ESP_SSL
     if (!ret) {
         char err[256];
@@ -1246,10 +1403,7 @@ bool WiFiClientSecureCtx::_installServerX509Validator(const X509List *client_CA_
             return false;
         }
         br_x509_minimal_init(_x509_minimal.get(), &br_sha256_vtable, _ta->getTrustAnchors(), _ta->getCount());
-        br_ssl_engine_set_default_rsavrfy(_eng);
-#ifndef BEARSSL_SSL_BASIC
-        br_ssl_engine_set_default_ecdsa(_eng);
-#endif
+        br_ssl_engine_install_m0_pk(_eng);
         br_x509_minimal_set_rsa(_x509_minimal.get(), br_ssl_engine_get_rsavrfy(_eng));
 #ifndef BEARSSL_SSL_BASIC
         br_x509_minimal_set_ecdsa(_x509_minimal.get(), br_ssl_engine_get_ec(_eng), br_ssl_engine_get_ecdsa(_eng));
@@ -1291,7 +1445,7 @@ bool WiFiClientSecureCtx::_connectSSLServerRSA(const X509List *chain,
     br_ssl_server_base_init(_sc_svr.get(), suites_server_rsa_P, sizeof(suites_server_rsa_P) / sizeof(suites_server_rsa_P[0]));
     br_ssl_server_set_single_rsa(_sc_svr.get(), chain ? chain->getX509Certs() : nullptr, chain ? chain->getCount() : 0,
                                  sk ? sk->getRSA() : nullptr, BR_KEYTYPE_KEYX | BR_KEYTYPE_SIGN,
-                                 br_rsa_private_get_default(), br_rsa_pkcs1_sign_get_default());
+                                 br_rsa_i15_private, br_rsa_i15_pkcs1_sign);
     br_ssl_engine_set_buffers_bidi(_eng, _iobuf_in.get(), _iobuf_in_size, _iobuf_out.get(), _iobuf_out_size);
     br_ssl_engine_set_versions(_eng, _tls_min, _tls_max);
     if (cache != nullptr) {
@@ -78,6 +78,11 @@ public:
         _session = session;
     }
 
+    // Cache used to resume sessions when no Session is set, e.g. &TLSSessions.  Off (nullptr) by default.
+    void setSessionCache(ClientSessionCache *cache) {
+        _sessionCache = cache;
+    }
+
     // Don't validate the chain, just accept whatever is given.  VERY INSECURE!
     void setInsecure() {
         _clearAuthenticationSettings();
@@ -127,6 +132,10 @@ public:
     // Return an error code and possibly a text string in a passed-in buffer with last SSL failure
     int getLastSSLError(char *dest = nullptr, size_t len = 0);
 
+    // SHA-256 of the contents of every setting deciding how the server is authenticated (and how
+    // we authenticate to it), equal only for connections which would validate a server the same way
+    void getAuthSettingsHash(uint8_t hash[32]);
+
     // Attach a preconfigured certificate store
     void setCertStore(CertStoreBase *certStore) {
         _certStore = certStore;
@@ -141,7 +150,6 @@ public:
     // Limit the TLS versions BearSSL will connect with.  Default is
     // BR_TLS10...BR_TLS12
     bool setSSLVersion(uint32_t min = BR_TLS10, uint32_t max = BR_TLS12);
-#if 0
     // peek buffer API is present
     virtual bool hasPeekBufferAPI() const override {
         return true;
@@ -158,7 +166,6 @@ public:
 
     // consume bytes after use (see peekBuffer)
     virtual void peekConsume(size_t consume) override;
-#endif
 
     // ESP32 compatibility
     void setCACert(const char *rootCA) {
@@ -283,6 +290,10 @@ private:
     // Optional storage space pointer for session parameters
     // Will be used on connect and updated on close
     Session *_session;
+    // Shared session cache used when _session isn't set
+    ClientSessionCache *_sessionCache;
+    void _sessionCacheKey(const char *hostName, uint8_t key[32]);
+    void _hashAuthSettings(br_sha256_context *sha);
 
     bool _use_insecure;
     bool _use_fingerprint;
@@ -302,6 +313,12 @@ private:
     unsigned char *_recvapp_buf;
     size_t _recvapp_len;
 
+    // Received record data being decrypted on core 1 (see stack_thunk_offload_begin())
+    thunk_recvrec_ack_job _recvJob;
+    bool _recvBusy;
+    bool _recvPending(); // Still running, so _eng is off limits
+    void _recvWait();
+
     bool _clientConnected(); // Is the underlying socket alive?
     std::shared_ptr<unsigned char> _alloc_iobuf(size_t sz);
     void _freeSSL();
@@ -441,6 +458,11 @@ public:
         _ctx->setSession(session);
     }
 
+    // Cache used to resume sessions when no Session is set, e.g. &TLSSessions.  Off (nullptr) by default.
+    void setSessionCache(ClientSessionCache *cache) {
+        _ctx->setSessionCache(cache);
+    }
+
     // Don't validate the chain, just accept whatever is given.  VERY INSECURE!
     void setInsecure() {
         _ctx->setInsecure();
@@ -494,6 +516,12 @@ public:
         return _ctx->getLastSSLError(dest, len);
     }
 
+    // SHA-256 of the contents of every setting deciding how the server is authenticated (and how
+    // we authenticate to it), equal only for connections which would validate a server the same way
+    void getAuthSettingsHash(uint8_t hash[32]) {
+        _ctx->getAuthSettingsHash(hash);
+    }
+
     // Attach a preconfigured certificate store
     void setCertStore(CertStoreBase *certStore) {
         _ctx->setCertStore(certStore);
@@ -521,7 +549,6 @@ public:
     static bool probeMaxFragmentLength(IPAddress ip, uint16_t port, uint16_t len);
     static bool probeMaxFragmentLength(const char *hostname, uint16_t port, uint16_t len);
     static bool probeMaxFragmentLength(const String& host, uint16_t port, uint16_t len);
-#if 0
     // peek buffer API is present
     virtual bool hasPeekBufferAPI() const override {
         return true;
@@ -542,7 +569,6 @@ public:
     virtual void peekConsume(size_t consume) override {
         return _ctx->peekConsume(consume);
     }
-#endif
 
     // ESP32 compatibility
     void setCACert(const char *rootCA) {
@@ -23,6 +23,7 @@
 #include <hardware/structs/scb.h>
 #include <hardware/sync.h>
 #include <hardware/flash.h>
+#include <hardware/dma.h>
 #include <pico/time.h>
 #include <hardware/gpio.h>
 #include <hardware/uart.h>
@@ -55,15 +56,375 @@ void dumphex(uint32_t x) {
 
 static OTACmdPage _ota_cmd;
 
-void do_ota() {
-    if (*__FS_START__ == *__FS_END__) {
+// Vector table of the app to run, moved by an A/B slot selection
+static uint32_t _app_vectors = XIP_BASE + 0x3000;
+
+// Nibble-at-a-time CRC32, 4x fewer steps than bitwise for a 64 byte table.  Chains like zlib's.
+static uint32_t ota_crc32(uint32_t crc, const void *d, uint32_t len) {
+    static const uint32_t crcNibble[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    const uint8_t *data = (const uint8_t *)d;
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crcNibble[crc & 15];
+        crc = (crc >> 4) ^ crcNibble[crc & 15];
+    }
+    return ~crc;
+}
+
+// Flash regions (a whole A/B slot on every boot) go through the DMA sniffer a word per
+// transfer.  Nothing else is running, so channel 0 is ours.
+static uint32_t ota_crc32_flash(uint32_t addr, uint32_t len) {
+    uint32_t crc = 0;
+    if (len >= 4) {
+        static uint32_t sink;
+        dma_channel_config c = dma_channel_get_default_config(0);
+        channel_config_set_sniff_enable(&c, true);
+        dma_hw->sniff_data = 0xffffffff;
+        dma_sniffer_enable(0, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+        // Reads back the bit-reversed, inverted accumulator, i.e. the finished zlib CRC
+        hw_set_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS | DMA_SNIFF_CTRL_OUT_INV_BITS);
+        dma_channel_configure(0, &c, &sink, (const void *)addr, len / 4, true);
+        dma_channel_wait_for_finish_blocking(0);
+        crc = dma_hw->sniff_data;
+        dma_sniffer_disable();
+    }
+    return ota_crc32(crc, (const void *)(addr + (len & ~3)), len & 3);
+}
+
+// Rolled SHA-256, only used by _OTA_VERIFY so size matters more than speed
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t ror(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void ota_sha256_block(uint32_t *state, const uint8_t *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[4 * i] << 24) | (p[4 * i + 1] << 16) | (p[4 * i + 2] << 8) | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+        uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void ota_sha256(const uint8_t *p, uint32_t len, uint8_t *out) {
+    uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    uint8_t tail[128];
+    uint32_t n;
+    for (n = len; n >= 64; n -= 64, p += 64) {
+        ota_sha256_block(state, p);
+    }
+    // Padding, then the length in bits as a 64-bit big-endian number
+    uint32_t blocks = (n < 56) ? 1 : 2;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, n);
+    tail[n] = 0x80;
+    tail[blocks * 64 - 5] = len >> 29;
+    for (int i = 0; i < 4; i++) {
+        tail[blocks * 64 - 1 - i] = (len << 3) >> (8 * i);
+    }
+    for (uint32_t i = 0; i < blocks; i++) {
+        ota_sha256_block(state, tail + 64 * i);
+    }
+    for (int i = 0; i < 32; i++) {
+        out[i] = state[i / 4] >> (24 - 8 * (i & 3));
+    }
+}
+
+// The journal, or NULL if the app didn't provide one (or it's for some other command page)
+static const OTAJournal *_journal;
+
+static uint8_t _journal_page[256];
+
+static bool journal_done(uint32_t rec) {
+    return _journal && (rec < sizeof(_journal->done)) && !_journal->done[rec];
+}
+
+// Programs len bytes of flash, within one 256 byte page, to 0.  NOR flash only needs an erase
+// to turn bits back on, so the rest of the page is just programmed with what's already there.
+static void ota_zero(const void *p, uint32_t len) {
+    uint32_t addr = (uint32_t)p;
+    memcpy(_journal_page, (const uint8_t *)(addr & ~255), sizeof(_journal_page));
+    memset(_journal_page + (addr & 255), 0, len);
+    int save = save_and_disable_interrupts();
+    flash_range_program((addr & ~255) - XIP_BASE, _journal_page, sizeof(_journal_page));
+    restore_interrupts(save);
+}
+
+// Programs one more record to 0
+static void journal_mark(uint32_t rec) {
+    if (!_journal || (rec >= sizeof(_journal->done))) {
         return;
     }
-    if (!lfsMount(*__FS_START__, 4096, *__FS_END__ - *__FS_START__)) {
-        uart_puts(uart0, "mount failed\n");
+    ota_zero(&_journal->done[rec], 1);
+}
+
+// Counts a failed verify and clears every record, so the next reset writes it all again.
+// Returns false once the retries are used up (or there's no journal to count them in).
+static bool journal_retry() {
+    if (!_journal) {
+        return false;
+    }
+    uint32_t n = 0;
+    while ((n < _OTA_VERIFY_RETRIES) && !_journal->retries[n]) {
+        n++;
+    }
+    if (n == _OTA_VERIFY_RETRIES) {
+        return false;
+    }
+    memcpy(_journal_page, _journal, sizeof(_journal_page));
+    _journal_page[offsetof(OTAJournal, retries) + n] = 0;
+    memset(_journal_page + offsetof(OTAJournal, done), 0xff, sizeof(_journal_page) - offsetof(OTAJournal, done));
+    int save = save_and_disable_interrupts();
+    flash_range_erase((intptr_t)_journal - XIP_BASE, 4096);
+    flash_range_program((intptr_t)_journal - XIP_BASE, _journal_page, sizeof(_journal_page));
+    restore_interrupts(save);
+    return true;
+}
+
+static bool ota_open(const commandEntry *c) {
+    uart_puts(uart0, "write: open ");
+    uart_puts(uart0, c->write.filename);
+    uart_puts(uart0, " = ");
+    if (!lfsOpen(c->write.filename)) {
+        uart_puts(uart0, "failed\n");
+        return false;
+    }
+    uart_puts(uart0, "success\n");
+    uart_puts(uart0, "seek ");
+    dumphex(c->write.fileOffset);
+    uart_puts(uart0, " = ");
+    if (!lfsSeek(c->write.fileOffset)) {
+        uart_puts(uart0, "failed\n");
+        return false;
+    }
+    uart_puts(uart0, "success\n");
+    return true;
+}
+
+static uint8_t _page_buff[4096];
+
+// Rebuilds every destination page of a delta patch.  When not programming this only checks
+// that each page either is already in flash or can be rebuilt from the current contents,
+// so a patch for a different base image is rejected before anything is erased.
+static bool ota_patch_pass(const commandEntry *c, const OTAPatchHeader *hdr, bool program) {
+    const uint8_t *flash = (const uint8_t *)c->write.flashAddress;
+    uint32_t pages = (hdr->dstLength + 4095) / 4096;
+    for (uint32_t n = 0; n < pages; n++) {
+        uint32_t page = (hdr->flags & _OTA_PATCH_DESCENDING) ? pages - 1 - n : n;
+        uint32_t start = page * 4096;
+        uint32_t len = (hdr->dstLength - start < 4096) ? hdr->dstLength - start : 4096;
+        uint32_t pos = 0;
+        memset(_page_buff, 0xff, sizeof(_page_buff));
+        while (pos < len) {
+            OTAPatchOp op;
+            if (!lfsReadTo((uint8_t *)&op, sizeof(op))) {
+                return false;
+            }
+            if ((op.diffLen > len - pos) || (op.extraLen > len - pos - op.diffLen)) {
+                return false;
+            }
+            if (op.diffLen) {
+                // Only sources the in-place write order hasn't overwritten yet
+                bool ok = (hdr->flags & _OTA_PATCH_DESCENDING) ? (op.srcOffset + op.diffLen <= start + 4096) : (op.srcOffset >= start);
+                if (!ok || (op.srcOffset + op.diffLen > hdr->srcLength) || !lfsReadTo(_page_buff + pos, op.diffLen)) {
+                    return false;
+                }
+                for (uint32_t j = 0; j < op.diffLen; j++) {
+                    _page_buff[pos + j] += flash[op.srcOffset + j];
+                }
+                pos += op.diffLen;
+            }
+            if (op.extraLen) {
+                if (!lfsReadTo(_page_buff + pos, op.extraLen)) {
+                    return false;
+                }
+                pos += op.extraLen;
+            }
+        }
+        uint32_t crc;
+        if (!lfsReadTo((uint8_t *)&crc, sizeof(crc))) {
+            return false;
+        }
+        if (ota_crc32_flash((uint32_t)flash + start, len) == crc) {
+            continue; // Unchanged, or written before a power failure
+        }
+        if (ota_crc32(0, _page_buff, len) != crc) {
+            uart_puts(uart0, "patch page mismatch ");
+            dumphex(start);
+            uart_puts(uart0, "\n");
+            return false;
+        }
+        if (program) {
+            int save = save_and_disable_interrupts();
+            flash_range_erase((intptr_t)flash + start - XIP_BASE, 4096);
+            flash_range_program((intptr_t)flash + start - XIP_BASE, _page_buff, 4096);
+            restore_interrupts(save);
+        }
+    }
+    return true;
+}
+
+static bool ota_patch(const commandEntry *c, const OTAPatchHeader *hdr) {
+    OTAPatchHeader skip;
+    uart_puts(uart0, "applying patch\n");
+    if (!ota_patch_pass(c, hdr, false) || !ota_open(c) || !lfsReadTo((uint8_t *)&skip, sizeof(skip))) {
+        return false;
+    }
+    if (!ota_patch_pass(c, hdr, true)) {
+        return false;
+    }
+    return ota_crc32_flash(c->write.flashAddress, hdr->dstLength) == hdr->dstCRC32;
+}
+
+// Copies one file to flash, journaling each page written from record rec on.  An image
+// including the OTA shim itself has the shim's sectors written last, so that a power failure
+// can only catch them once everything else is in place.
+static bool ota_write(const commandEntry *c, uint32_t rec, uint32_t pages) {
+    if (journal_done(rec + pages - 1)) {
+        uart_puts(uart0, "write: already done\n");
+        return true;
+    }
+    if (!ota_open(c)) {
+        return false;
+    }
+    OTAPatchHeader hdr;
+    if ((c->write.fileLength >= sizeof(hdr)) && lfsReadTo((uint8_t *)&hdr, sizeof(hdr)) && (hdr.magic == _OTA_PATCH_MAGIC)) {
+        // Patches check every page against flash, so they resume by themselves
+        if (!ota_patch(c, &hdr)) {
+            uart_puts(uart0, "patch failed\n");
+            return false;
+        }
+        journal_mark(rec + pages - 1);
+        return true;
+    }
+
+    uint32_t data = (c->write.fileLength + 4095) / 4096; // Only differs from pages when empty
+    uint32_t shim = ((c->write.flashAddress == XIP_BASE) && (data > 3)) ? 3 : 0;
+    uint32_t pos = ~0; // Unknown after the header check, so seek before the first read
+    for (uint32_t n = 0; n < data; n++) {
+        if (journal_done(rec + n)) {
+            continue;
+        }
+        uint32_t page = (n < data - shim) ? n + shim : n - (data - shim);
+        uint32_t offset = page * 4096;
+        uint32_t len = (c->write.fileLength - offset < 4096) ? c->write.fileLength - offset : 4096;
+        uint32_t toWrite = c->write.flashAddress + offset;
+        if ((pos != offset) && !lfsSeek(c->write.fileOffset + offset)) {
+            uart_puts(uart0, "seek failed\n");
+            return false;
+        }
+        uint8_t *p = lfsRead(len);
+        if (!p) {
+            uart_puts(uart0, "read failed\n");
+            return false;
+        }
+        pos = offset + len;
+        uart_puts(uart0, "towrite = ");
+        dumphex(toWrite);
+        uart_puts(uart0, "\n");
+        // Only write pages which differ (i.e. preserve OTA pages unless the OTA shim changes)
+        if (memcmp(p, (void*)toWrite, 4096)) {
+            uart_puts(uart0, "writing\n");
+            int save = save_and_disable_interrupts();
+            flash_range_erase((intptr_t)toWrite - XIP_BASE, 4096);
+            flash_range_program((intptr_t)toWrite - XIP_BASE, (const uint8_t *)p, 4096);
+            restore_interrupts(save);
+        } else {
+            uart_puts(uart0, "identical to flash, skipping\n");
+        }
+        journal_mark(rec + n);
+    }
+    if (data < pages) {
+        journal_mark(rec + pages - 1);
+    }
+    lfsClose();
+    return true;
+}
+
+static bool ota_verify(const commandEntry *c, uint32_t rec) {
+    uint8_t sha256[32];
+    if (journal_done(rec)) {
+        return true;
+    }
+    ota_sha256((const uint8_t *)c->verify.flashAddress, c->verify.length, sha256);
+    if (memcmp(sha256, c->verify.sha256, sizeof(sha256))) {
+        uart_puts(uart0, "verify: sha256 mismatch\n");
+        return false;
+    }
+    journal_mark(rec);
+    return true;
+}
+
+// Journal records used by a command
+static uint32_t ota_records(const commandEntry *c) {
+    if (c->command == _OTA_WRITE) {
+        return c->write.fileLength ? (c->write.fileLength + 4095) / 4096 : 1;
+    }
+    return (c->command == _OTA_VERIFY) ? 1 : 0;
+}
+
+// Picks the A/B slot to run, if one was selected.  Updates into a slot never touch the command
+// page, so this is kept in a file of its own and survives any later commit.
+static void ota_slot() {
+    const OTASlot *s = (const OTASlot *)lfsBlockFile(_OTA_SLOT_FILE);
+    if (!s || memcmp(s->sign, "Pico A/B", 8) || !s->failed) {
         return;
     }
+    uart_puts(uart0, "boot: slot ");
+    dumphex(s->flashAddress);
+    if (s->checked) {
+        // First boot since it was selected, remember the result so this is the only CRC32 pass
+        bool ok = ota_crc32_flash(s->flashAddress, s->length) == s->crc32;
+        ota_zero(ok ? &s->checked : &s->failed, sizeof(uint32_t));
+        if (!ok) {
+            uart_puts(uart0, " = crc32 mismatch, using default app\n");
+            return;
+        }
+    }
+    uart_puts(uart0, " = success\n");
+    _app_vectors = s->flashAddress + 0x3000;
+}
 
+static void ota_commands() {
     // We are very naughty and record the last block read, since it should be the actual data block of the
     // OTA structure.  We'll erase it behind the scenes to avoid bringing in all of LittleFS write infra.
     uint32_t blockToErase;
@@ -75,20 +436,7 @@ void do_ota() {
         return; // No signature
     }
 
-    uint32_t crc = 0xffffffff;
-    const uint8_t *data = (const uint8_t *)&_ota_cmd;
-    for (uint32_t i = 0; i < offsetof(OTACmdPage, crc32); i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xedb88320;
-            } else {
-                crc >>= 1;
-            }
-        }
-    }
-    crc = ~crc;
-    if (crc != _ota_cmd.crc32) {
+    if (ota_crc32(0, &_ota_cmd, offsetof(OTACmdPage, crc32)) != _ota_cmd.crc32) {
         uart_puts(uart0, "\ncrc32 mismatch\n");
         return;
     }
@@ -98,59 +446,52 @@ void do_ota() {
         return;
     }
 
+    if (_ota_cmd.count > _OTA_MAX_COMMANDS) {
+        return;
+    }
+
+    // Resume from the journal, as long as it belongs to these commands and can hold them all
+    uint32_t records = 0;
+    for (uint32_t i = 0; i < _ota_cmd.count; i++) {
+        records += ota_records(&_ota_cmd.cmd[i]);
+    }
+    _journal = records ? (const OTAJournal *)lfsBlockFile(_OTA_JOURNAL_FILE) : NULL;
+    if (_journal && ((_journal->crc32 != _ota_cmd.crc32) || (records > sizeof(_journal->done)))) {
+        _journal = NULL;
+    }
+
+    bool wrote = false;
+    uint32_t rec = 0;
     for (uint32_t i = 0; i < _ota_cmd.count; i++) {
         switch (_ota_cmd.cmd[i].command) {
             case _OTA_WRITE:
-                uart_puts(uart0, "write: open ");
-                uart_puts(uart0, _ota_cmd.cmd[i].write.filename);
-                uart_puts(uart0, " = ");
-                if (!lfsOpen(_ota_cmd.cmd[i].write.filename)) {
-                    uart_puts(uart0, "failed\n");
+                wrote = true;
+                if (!ota_write(&_ota_cmd.cmd[i], rec, ota_records(&_ota_cmd.cmd[i]))) {
                     return;
                 }
-                uart_puts(uart0, "success\n");
-                uart_puts(uart0, "seek ");
-                dumphex(_ota_cmd.cmd[i].write.fileOffset);
-                uart_puts(uart0, " = ");
-                if (!lfsSeek(_ota_cmd.cmd[i].write.fileOffset)) {
-                    uart_puts(uart0, "failed\n");
-                    return;
-                }
-                uart_puts(uart0, "success\n");
-                uint32_t toRead = _ota_cmd.cmd[i].write.fileLength;
-                uint32_t toWrite = _ota_cmd.cmd[i].write.flashAddress;
-
-                while (toRead) {
-                    uint32_t len = (toRead < 4096) ? toRead : 4096;
-                    uint8_t *p = lfsRead(len);
-                    if (!p) {
-                        uart_puts(uart0, "read failed\n");
-                        return;
+                break;
+            case _OTA_VERIFY:
+                wrote = true;
+                if (!ota_verify(&_ota_cmd.cmd[i], rec)) {
+                    // Never run an image which failed, reset to write it again or give up on it
+                    if (!journal_retry()) {
+                        uart_puts(uart0, "verify: giving up\n");
+                        lfsEraseBlock(blockToErase);
                     }
-                    uart_puts(uart0, "toread = ");
-                    dumphex(toRead);
-                    uart_puts(uart0, "\ntowrite = ");
-                    dumphex(toWrite);
-                    uart_puts(uart0, "\n");
-                    // Only write pages which differ (i.e. preserve OTA pages unless the OTA shim changes)
-                    if (memcmp(p, (void*)toWrite, 4096)) {
-                        uart_puts(uart0, "writing\n");
-                        int save = save_and_disable_interrupts();
-                        flash_range_erase((intptr_t)toWrite - XIP_BASE, 4096);
-                        flash_range_program((intptr_t)toWrite - XIP_BASE, (const uint8_t *)p, 4096);
-                        restore_interrupts(save);
-                    } else {
-                        uart_puts(uart0, "identical to flash, skipping\n");
+                    watchdog_reboot(0, 0, 100);
+                    while (1) {
+                        continue;
                     }
-                    toRead -= len;
-                    toWrite += 4096;
                 }
-                lfsClose();
                 break;
             default:
-                // TODO - verify
                 break;
         }
+        rec += ota_records(&_ota_cmd.cmd[i]);
+    }
+
+    if (!wrote) {
+        return;
     }
 
     uart_puts(uart0, "\nota completed\n");
@@ -160,6 +501,21 @@ void do_ota() {
 
     // Do a hard reset just in case the start up sequence is not the same
     watchdog_reboot(0, 0, 100);
+    while (1) {
+        continue;
+    }
+}
+
+void do_ota() {
+    if (*__FS_START__ == *__FS_END__) {
+        return;
+    }
+    if (!lfsMount(*__FS_START__, 4096, *__FS_END__ - *__FS_START__)) {
+        uart_puts(uart0, "mount failed\n");
+        return;
+    }
+    ota_commands();
+    ota_slot();
 }
 
 
@@ -180,12 +536,12 @@ int main(int a, unsigned char **b) {
     do_ota();
 
     // Reset the interrupt/etc. vectors to the real app.  Will be copied to RAM in app's runtime_init
-    scb_hw->vtor = (uint32_t)0x10003000;
+    scb_hw->vtor = _app_vectors;
 
     // Jump to it
     register uint32_t* sp asm("sp");
-    register uint32_t _sp = *(uint32_t *)0x10003000;
-    register void (*fcn)(void) = (void (*)(void)) *(uint32_t *)0x10003004;
+    register uint32_t _sp = *(uint32_t *)_app_vectors;
+    register void (*fcn)(void) = (void (*)(void)) *(uint32_t *)(_app_vectors + 4);
     sp = (uint32_t *)_sp;
     fcn();
 
@@ -22,7 +22,9 @@
 #include <stdint.h>
 
 #define _OTA_WRITE 1
-#define _OTA_VERIFY 1
+#define _OTA_VERIFY 2 // Check a SHA-256 of flash after the writes before it
+
+#define _OTA_MAX_COMMANDS 32
 
 typedef struct {
     uint32_t command;
@@ -33,6 +35,14 @@ typedef struct {
             uint32_t fileLength;
             uint32_t flashAddress;   // Normally XIP_BASE
         } write;
+        // A mismatch never runs the image.  The failure is counted in the journal and the board
+        // reset, writing every entry again, up to _OTA_VERIFY_RETRIES times.  After that (or at
+        // once without a journal) the command page is erased so a bad file isn't rewritten forever.
+        struct {
+            uint32_t flashAddress;
+            uint32_t length;
+            uint8_t sha256[32];
+        } verify;
     };
 } commandEntry;
 
@@ -42,9 +52,67 @@ typedef struct {
 
     // List of operations
     uint32_t count;
-    commandEntry cmd[8];
+    commandEntry cmd[_OTA_MAX_COMMANDS];
 
     uint32_t crc32; // CRC32 over just the contents of this struct, up until just before this value
 } OTACmdPage;
 
 #define _OTA_COMMAND_FILE "otacommand.bin"
+
+// Progress of the command page, so an update interrupted by a reset resumes where it stopped.
+// PicoOTA writes this file fully erased apart from the header, and the shim programs it in
+// place, behind LittleFS's back, so it must occupy exactly one 4K block.  Each _OTA_WRITE
+// owns one record per 4K page of its file (at least one), in the order they are written, and
+// each _OTA_VERIFY owns one.  A record reads 0 once that work is complete.
+#define _OTA_JOURNAL_FILE "otajournal.bin"
+
+#define _OTA_VERIFY_RETRIES 3
+
+typedef struct {
+    uint32_t crc32;          // OTACmdPage.crc32 of the commands this journal tracks
+    uint8_t retries[4];      // One more reads 0 after each failed _OTA_VERIFY
+    uint8_t reserved[8];
+    uint8_t done[4096 - 16];
+} OTAJournal;
+
+// The A/B slot to run instead of the default app at XIP_BASE, kept apart from the command page
+// so that later updates don't lose it.  Like the journal it must occupy exactly one 4K block,
+// since the shim programs it in place.  The slot's CRC32 is only checked on the first boot
+// after it was selected, which then programs either checked or failed to 0.  A slot which
+// fails the check is never run, and the default app is run instead.
+#define _OTA_SLOT_FILE "otaslot.bin"
+
+typedef struct {
+    uint8_t sign[8];         // "Pico A/B"
+    uint32_t flashAddress;   // Start of the slot, including its boot2/OTA prefix
+    uint32_t length;
+    uint32_t crc32;
+    uint32_t checked;        // 0 once crc32 has matched
+    uint32_t failed;         // 0 once crc32 has not
+    uint8_t reserved[4096 - 28];
+} OTASlot;
+
+// A _OTA_WRITE whose file (after any GZIP decompression) begins with this header is a delta
+// patch against the image currently in flash at flashAddress, made by tools/otadelta.py
+#define _OTA_PATCH_MAGIC 0x46494450 // "PDIF"
+#define _OTA_PATCH_DESCENDING 1     // Pages are generated last to first
+
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t srcLength;
+    uint32_t srcCRC32;
+    uint32_t dstLength;
+    uint32_t dstCRC32;
+} OTAPatchHeader;
+
+// The header is followed, for each 4K destination page in the order they're written, by ops
+// which exactly fill the page and then the CRC32 of the page.  Each op is followed by diffLen
+// bytes to add to the source starting at srcOffset and then extraLen literal bytes.  Ops
+// only reference source bytes which haven't been overwritten yet (at or after the page start
+// when ascending, before the page end when descending), so the patch applies in place.
+typedef struct {
+    uint32_t diffLen;
+    uint32_t srcOffset;
+    uint32_t extraLen;
+} OTAPatchOp;
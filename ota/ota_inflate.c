@@ -0,0 +1,538 @@
+/*
+    ota_inflate.c - Streaming GZIP decompression for OTA operations
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// A small inflate (RFC 1951/1952) built for the OTA shim.  Output goes straight into the
+// 32K window, which is also the history for matches, so there is no second copy of every
+// byte.  Huffman codes of up to FAST_BITS are decoded with a single table lookup, which
+// also returns two literals at once when both fit.  Longer codes fall back to walking the
+// canonical code a bit at a time.
+
+#include <string.h>
+#include "ota_inflate.h"
+
+#define FAST_BITS     10      // Codes this long or shorter take one lookup
+#define WSIZE         32768   // Deflate window, used as the output ring
+#define WMASK         (WSIZE - 1)
+#define INDEX_SIZE    64      // Seek points remembered
+#define INDEX_SPACING 16384   // Minimum decompressed bytes between seek points
+
+// Fast table entries: [3:0] bits used, [7:4] bits of the first of two literals, [15:8] second
+// literal, [24:16] symbol, [31] two literals.  0 means the code is longer than FAST_BITS.
+#define E_LEN(e)  ((e) & 15)
+#define E_LEN1(e) (((e) >> 4) & 15)
+#define E_SYM2(e) (((e) >> 8) & 255)
+#define E_SYM(e)  (((e) >> 16) & 511)
+#define E_PAIR    (1u << 31)
+
+typedef struct {
+    uint16_t count[16];     // Number of codes of each length
+    uint16_t symbol[288];   // Symbols in canonical code order
+    uint32_t fast[1 << FAST_BITS];
+} huff_t;
+
+// A block boundary which no later match reaches back past, so decoding can restart there
+// with an empty window
+typedef struct {
+    uint32_t out;   // Decompressed offset
+    uint32_t bit;   // Compressed offset, in bits
+} seekpoint_t;
+
+enum { S_BLOCK, S_STORED, S_HUFF, S_DONE };
+
+static const uint16_t lbase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lext[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dbase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t dext[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static otaInflateReadCB _read;
+static otaInflateSeekCB _seek;
+static void *_ctx;
+
+static uint8_t __attribute__((aligned(4))) _in[4096];
+static uint32_t _inPos;
+static uint32_t _inLen;
+static uint32_t _inBase;    // File offset of _in[0]
+static uint32_t _over;      // Zero bytes made up past the end of the file
+static uint32_t _bitbuf;
+static uint32_t _bitcnt;
+
+static uint8_t __attribute__((aligned(4))) _window[WSIZE];
+static uint32_t _out;       // Total decompressed so far
+static uint32_t _state;
+static bool _last;
+static uint32_t _len;       // Pending stored bytes or match length
+static uint32_t _dist;
+static huff_t _lit;
+static huff_t _dst;
+
+static seekpoint_t _index[INDEX_SIZE];
+static uint32_t _indexCount;
+static seekpoint_t _cand;
+static bool _candValid;
+
+static uint32_t next_byte() {
+    if (_inPos == _inLen) {
+        _inBase += _inLen;
+        int len = _read(_ctx, _in, sizeof(_in));
+        _inLen = (len > 0) ? len : 0;
+        _inPos = 0;
+        if (!_inLen) {
+            _over++;
+            return 0;
+        }
+    }
+    return _in[_inPos++];
+}
+
+static inline void need(uint32_t n) {
+    while (_bitcnt < n) {
+        _bitbuf |= next_byte() << _bitcnt;
+        _bitcnt += 8;
+    }
+}
+
+static uint32_t bits(uint32_t n) {
+    need(n);
+    uint32_t v = _bitbuf & ((1u << n) - 1);
+    _bitbuf >>= n;
+    _bitcnt -= n;
+    return v;
+}
+
+static bool build(huff_t *h, const uint8_t *lens, uint32_t n, bool pairs) {
+    uint16_t offs[16];
+    memset(h->count, 0, sizeof(h->count));
+    for (uint32_t i = 0; i < n; i++) {
+        h->count[lens[i]]++;
+    }
+    h->count[0] = 0;
+    int left = 1;
+    offs[1] = 0;
+    for (uint32_t len = 1; len < 16; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0) {
+            return false; // Over-subscribed
+        }
+        if (len < 15) {
+            offs[len + 1] = offs[len] + h->count[len];
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (lens[i]) {
+            h->symbol[offs[lens[i]]++] = i;
+        }
+    }
+
+    // Codes are sent MSB first but read LSB first, so index the table by the reversed code
+    memset(h->fast, 0, sizeof(h->fast));
+    uint32_t code = 0;
+    uint32_t idx = 0;
+    for (uint32_t len = 1; len <= FAST_BITS; len++, code <<= 1) {
+        for (uint32_t k = 0; k < h->count[len]; k++, code++) {
+            uint32_t rev = 0;
+            for (uint32_t b = 0; b < len; b++) {
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            uint32_t e = (h->symbol[idx++] << 16) | len;
+            for (uint32_t j = rev; j < (1 << FAST_BITS); j += 1 << len) {
+                h->fast[j] = e;
+            }
+        }
+    }
+
+    // Add a second literal wherever one follows within the same lookup.  Going downwards
+    // only ever reads entries (i >> len < i) which haven't been paired yet.
+    if (pairs) {
+        for (uint32_t i = 1 << FAST_BITS; i-- > 0;) {
+            uint32_t e = h->fast[i];
+            uint32_t l1 = E_LEN(e);
+            if (!l1 || (E_SYM(e) > 255)) {
+                continue;
+            }
+            uint32_t e2 = h->fast[i >> l1];
+            uint32_t l2 = E_LEN(e2);
+            if (l2 && (E_SYM(e2) < 256) && (l1 + l2 <= FAST_BITS)) {
+                h->fast[i] = (e & 0x01ff0000) | E_PAIR | (E_SYM(e2) << 8) | (l1 << 4) | (l1 + l2);
+            }
+        }
+    }
+    return true;
+}
+
+static int decode_slow(const huff_t *h) {
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (uint32_t len = 1; len < 16; len++) {
+        code |= bits(1);
+        int count = h->count[len];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int decode(const huff_t *h) {
+    need(FAST_BITS);
+    uint32_t e = h->fast[_bitbuf & ((1 << FAST_BITS) - 1)];
+    if (!E_LEN(e)) {
+        return decode_slow(h);
+    }
+    _bitbuf >>= E_LEN(e);
+    _bitcnt -= E_LEN(e);
+    return E_SYM(e);
+}
+
+static void fixed_tables() {
+    uint8_t lens[288 + 30];
+    memset(lens, 8, 144);
+    memset(lens + 144, 9, 112);
+    memset(lens + 256, 7, 24);
+    memset(lens + 280, 8, 8);
+    memset(lens + 288, 5, 30);
+    build(&_lit, lens, 288, true);
+    build(&_dst, lens + 288, 30, false);
+}
+
+static bool dynamic_tables() {
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t lens[286 + 30];
+    uint32_t nlen = bits(5) + 257;
+    uint32_t ndist = bits(5) + 1;
+    uint32_t ncode = bits(4) + 4;
+    if ((nlen > 286) || (ndist > 30)) {
+        return false;
+    }
+    memset(lens, 0, 19);
+    for (uint32_t i = 0; i < ncode; i++) {
+        lens[order[i]] = bits(3);
+    }
+    if (!build(&_lit, lens, 19, false)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < nlen + ndist;) {
+        int sym = decode(&_lit);
+        if (sym < 0) {
+            return false;
+        }
+        if (sym < 16) {
+            lens[i++] = sym;
+            continue;
+        }
+        uint32_t val = 0;
+        uint32_t rep;
+        if (sym == 16) {
+            if (!i) {
+                return false;
+            }
+            val = lens[i - 1];
+            rep = 3 + bits(2);
+        } else if (sym == 17) {
+            rep = 3 + bits(3);
+        } else {
+            rep = 11 + bits(7);
+        }
+        if (i + rep > nlen + ndist) {
+            return false;
+        }
+        while (rep--) {
+            lens[i++] = val;
+        }
+    }
+    if (!lens[256]) {
+        return false; // No end of block code
+    }
+    return build(&_lit, lens, nlen, true) && build(&_dst, lens + nlen, ndist, false);
+}
+
+static bool block_start() {
+    if (_last) {
+        _state = S_DONE;
+        return false;
+    }
+    // Candidate seek point, kept if nothing in the next 32K refers back before it
+    if (!_candValid && (_indexCount < INDEX_SIZE) && (_out >= _index[_indexCount - 1].out + INDEX_SPACING)) {
+        _cand.out = _out;
+        _cand.bit = (_inBase + _inPos + _over) * 8 - _bitcnt;
+        _candValid = true;
+    }
+    _last = bits(1);
+    switch (bits(2)) {
+    case 0:
+        bits(_bitcnt & 7);
+        _len = bits(16);
+        if ((bits(16) ^ 0xffff) != _len) {
+            return false;
+        }
+        _state = _len ? S_STORED : S_BLOCK;
+        return true;
+    case 1:
+        fixed_tables();
+        break;
+    case 2:
+        if (!dynamic_tables()) {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+    _state = S_HUFF;
+    return true;
+}
+
+// Decodes symbols until the target or the end of the block.  Matches which would run past
+// the target are left pending in _len/_dist.  The bit buffer lives in locals here since the
+// window stores could otherwise alias it.
+static bool huff(uint32_t target) {
+    uint32_t out = _out;
+    uint32_t bitbuf = _bitbuf;
+    uint32_t bitcnt = _bitcnt;
+    bool ok = false;
+    while (out < target) {
+        while (bitcnt <= 24) {
+            bitbuf |= next_byte() << bitcnt;
+            bitcnt += 8;
+        }
+        uint32_t e = _lit.fast[bitbuf & ((1 << FAST_BITS) - 1)];
+        int sym;
+        if ((e & E_PAIR) && (out + 1 < target)) {
+            bitbuf >>= E_LEN(e);
+            bitcnt -= E_LEN(e);
+            _window[out++ & WMASK] = E_SYM(e);
+            _window[out++ & WMASK] = E_SYM2(e);
+            continue;
+        } else if (e & E_PAIR) {
+            bitbuf >>= E_LEN1(e);
+            bitcnt -= E_LEN1(e);
+            sym = E_SYM(e);
+        } else if (E_LEN(e)) {
+            bitbuf >>= E_LEN(e);
+            bitcnt -= E_LEN(e);
+            sym = E_SYM(e);
+        } else {
+            _bitbuf = bitbuf;
+            _bitcnt = bitcnt;
+            sym = decode_slow(&_lit);
+            bitbuf = _bitbuf;
+            bitcnt = _bitcnt;
+        }
+        if ((sym >= 0) && (sym < 256)) {
+            _window[out++ & WMASK] = sym;
+            continue;
+        }
+        if (sym == 256) {
+            _state = S_BLOCK;
+            ok = true;
+            break;
+        }
+        sym -= 257;
+        if ((sym < 0) || (sym >= 29)) {
+            break;
+        }
+        _bitbuf = bitbuf;
+        _bitcnt = bitcnt;
+        uint32_t len = lbase[sym] + bits(lext[sym]);
+        int ds = decode(&_dst);
+        if ((ds < 0) || (ds >= 30)) {
+            return false;
+        }
+        uint32_t dist = dbase[ds] + bits(dext[ds]);
+        bitbuf = _bitbuf;
+        bitcnt = _bitcnt;
+        if (dist > out) {
+            return false;
+        }
+        if (_candValid && (out - dist < _cand.out)) {
+            _candValid = false;
+        }
+        if (len > target - out) {
+            _len = len - (target - out);
+            _dist = dist;
+            len = target - out;
+        }
+        while (len--) {
+            _window[out & WMASK] = _window[(out - dist) & WMASK];
+            out++;
+        }
+    }
+    _out = out;
+    _bitbuf = bitbuf;
+    _bitcnt = bitcnt;
+    return ok || (out >= target);
+}
+
+static bool inflate_until(uint32_t target) {
+    while (_out < target) {
+        if (_over > 4) {
+            return false; // Ran off the end of the file
+        }
+        if (_candValid && (_out >= _cand.out + WSIZE)) {
+            _index[_indexCount++] = _cand;
+            _candValid = false;
+        }
+        if (_len) {
+            uint32_t n = (_len < target - _out) ? _len : target - _out;
+            _len -= n;
+            if (_state == S_STORED) {
+                while (n) {
+                    if (_bitcnt || (_inPos == _inLen)) {
+                        _window[_out++ & WMASK] = _bitcnt ? bits(8) : next_byte();
+                        n--;
+                        continue;
+                    }
+                    uint32_t c = _inLen - _inPos;
+                    c = (c < n) ? c : n;
+                    c = (c < WSIZE - (_out & WMASK)) ? c : WSIZE - (_out & WMASK);
+                    memcpy(_window + (_out & WMASK), _in + _inPos, c);
+                    _inPos += c;
+                    _out += c;
+                    n -= c;
+                }
+                if (!_len) {
+                    _state = S_BLOCK;
+                }
+            } else {
+                while (n--) {
+                    _window[_out & WMASK] = _window[(_out - _dist) & WMASK];
+                    _out++;
+                }
+            }
+            continue;
+        }
+        bool ok;
+        switch (_state) {
+        case S_BLOCK:
+            ok = block_start();
+            break;
+        case S_HUFF:
+            ok = huff(target);
+            break;
+        default:
+            ok = false; // Stream ended early
+            break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool restart(const seekpoint_t *p) {
+    if (!_seek(_ctx, p->bit / 8)) {
+        return false;
+    }
+    _inBase = p->bit / 8;
+    _inPos = 0;
+    _inLen = 0;
+    _over = 0;
+    _bitbuf = 0;
+    _bitcnt = 0;
+    bits(p->bit & 7);
+    _out = p->out;
+    _state = S_BLOCK;
+    _last = false;
+    _len = 0;
+    _candValid = false;
+    return true;
+}
+
+bool otaInflateBegin(otaInflateReadCB read, otaInflateSeekCB seek, void *ctx, bool keepIndex) {
+    _read = read;
+    _seek = seek;
+    _ctx = ctx;
+    _inPos = 0;
+    _inLen = 0;
+    _inBase = 0;
+    _over = 0;
+    _bitbuf = 0;
+    _bitcnt = 0;
+
+    if ((next_byte() != 0x1f) || (next_byte() != 0x8b) || (next_byte() != 8)) {
+        return false;
+    }
+    uint32_t flags = next_byte();
+    for (int i = 0; i < 6; i++) {
+        next_byte(); // MTIME, XFL, OS
+    }
+    if (flags & 4) {
+        uint32_t n = next_byte();
+        n |= next_byte() << 8;
+        while (n-- && !_over) {
+            next_byte();
+        }
+    }
+    if (flags & 8) {
+        while (next_byte() && !_over); // Name
+    }
+    if (flags & 16) {
+        while (next_byte() && !_over); // Comment
+    }
+    if (flags & 2) {
+        next_byte(); // Header CRC
+        next_byte();
+    }
+    if (_over) {
+        return false;
+    }
+
+    if (!keepIndex || !_indexCount) {
+        _index[0].out = 0;
+        _index[0].bit = (_inBase + _inPos) * 8;
+        _indexCount = 1;
+    }
+    _out = 0;
+    _state = S_BLOCK;
+    _last = false;
+    _len = 0;
+    _candValid = false;
+    return true;
+}
+
+uint8_t *otaInflateRead(uint8_t *dst, uint32_t len) {
+    uint32_t start = _out & WMASK;
+    if ((len > WSIZE) || !inflate_until(_out + len)) {
+        return NULL;
+    }
+    if (start + len <= WSIZE) {
+        return _window + start;
+    }
+    memcpy(dst, _window + start, WSIZE - start);
+    memcpy(dst + WSIZE - start, _window, len - (WSIZE - start));
+    return dst;
+}
+
+bool otaInflateSeek(uint32_t offset) {
+    // Restart from the last seek point before the offset if going backwards or if it saves work
+    uint32_t i = _indexCount - 1;
+    while (i && (_index[i].out > offset)) {
+        i--;
+    }
+    if ((offset < _out) || (_index[i].out > _out)) {
+        if (!restart(&_index[i])) {
+            return false;
+        }
+    }
+    return inflate_until(offset);
+}
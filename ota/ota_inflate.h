@@ -0,0 +1,38 @@
+/*
+    ota_inflate.h - Streaming GZIP decompression for OTA operations
+    Copyright (c) 2023 Earle F. Philhower, III.  All rights reserved.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Compressed data source.  read returns the bytes read, 0 at the end of the file.
+typedef int (*otaInflateReadCB)(void *ctx, uint8_t *dst, uint32_t len);
+typedef bool (*otaInflateSeekCB)(void *ctx, uint32_t offset);
+
+// Starts decompressing a GZIP file.  When keepIndex is set the file must be the same one
+// as before, and the seek points already found in it are kept.
+bool otaInflateBegin(otaInflateReadCB read, otaInflateSeekCB seek, void *ctx, bool keepIndex);
+
+// Decompresses the next len bytes and returns a pointer to them, inside the decoder's
+// window when they don't wrap around it and otherwise in dst.  Valid until the next call.
+uint8_t *otaInflateRead(uint8_t *dst, uint32_t len);
+
+// Moves to an absolute offset in the decompressed data
+bool otaInflateSeek(uint32_t offset);
@@ -24,7 +24,7 @@
 
 #include "../libraries/LittleFS/lib/littlefs/lfs.h"
 #include "../libraries/LittleFS/lib/littlefs/lfs_util.h"
-#include "./uzlib/src/uzlib.h"
+#include "ota_inflate.h"
 
 static lfs_t _lfs;
 static struct lfs_config  _lfs_cfg;
@@ -104,10 +104,8 @@ bool lfsMount(uint8_t *start, uint32_t blockSize, uint32_t size) {
 static bool _gzip = false;
 static lfs_file_t _file;
 
-static unsigned char __attribute__((aligned(4))) uzlib_read_buff[4096];
-static unsigned char gzip_dict[32768];
 static uint8_t _flash_buff[4096]; // no room for this on the stack
-static struct uzlib_uncomp m_uncomp;
+static char _gzipName[64]; // Last GZIP file opened, whose seek points are still valid
 
 static uint8_t _ota_buff[256];
 static struct lfs_file_config _ota_cfg = { (void *)_ota_buff, NULL, 0 };
@@ -130,11 +128,28 @@ bool lfsReadOTA(OTACmdPage *ota, uint32_t *blockToErase) {
     return true;
 }
 
-static int uzlib_read_cb(struct uzlib_uncomp *m) {
-    m->source = uzlib_read_buff;
-    int len = lfs_file_read(&_lfs, &_file, uzlib_read_buff, sizeof(uzlib_read_buff));
-    m->source_limit = uzlib_read_buff + len;
-    return *(m->source++);
+// Finds the flash holding a file which exactly fills one block, so it can be programmed in place
+uint8_t *lfsBlockFile(const char *filename) {
+    lfs_file_t f;
+    if (lfs_file_opencfg(&_lfs, &f, filename, LFS_O_RDONLY, &_file_cfg) < 0) {
+        return NULL;
+    }
+    uint8_t *ret = NULL;
+    if ((lfs_file_size(&_lfs, &f) == (lfs_soff_t)_blockSize) && (_blockSize == lfs_file_read(&_lfs, &f, _flash_buff, _blockSize))) {
+        ret = _start + _lastBlock * _blockSize;
+    }
+    lfs_file_close(&_lfs, &f);
+    return ret;
+}
+
+static int lfs_inflate_read(void *ctx, uint8_t *dst, uint32_t len) {
+    (void) ctx;
+    return lfs_file_read(&_lfs, &_file, dst, len);
+}
+
+static bool lfs_inflate_seek(void *ctx, uint32_t offset) {
+    (void) ctx;
+    return lfs_file_seek(&_lfs, &_file, offset, LFS_SEEK_SET) >= 0;
 }
 
 bool lfsOpen(const char *filename) {
@@ -148,46 +163,44 @@ bool lfsOpen(const char *filename) {
     }
     lfs_file_rewind(&_lfs, &_file);
     if ((b[0] == 0x1f) && (b[1] == 0x8b)) {
-        uzlib_init();
-        m_uncomp.source = NULL;
-        m_uncomp.source_limit = NULL;
-        m_uncomp.source_read_cb = uzlib_read_cb;
-        uzlib_uncompress_init(&m_uncomp, gzip_dict, sizeof(gzip_dict));
-        int res = uzlib_gzip_parse_header(&m_uncomp);
-        if (res != TINF_OK) {
+        bool same = !strncmp(_gzipName, filename, sizeof(_gzipName));
+        strncpy(_gzipName, filename, sizeof(_gzipName));
+        if (!otaInflateBegin(lfs_inflate_read, lfs_inflate_seek, NULL, same)) {
+            _gzipName[0] = 0;
             lfs_file_rewind(&_lfs, &_file);
             return false; // Error uncompress header read, could have been false alarm
         }
         _gzip = true;
-
     }
     return true;
 }
 
 bool lfsSeek(uint32_t offset) {
-    while (offset) {
-        uint32_t to_read = (offset > sizeof(_flash_buff)) ? sizeof(_flash_buff) : offset;
-        if (!lfsRead(to_read)) {
-            return false;
-        }
-        offset -= to_read;
+    if (_gzip) {
+        return otaInflateSeek(offset);
     }
-    return true;
+    return lfs_file_seek(&_lfs, &_file, offset, LFS_SEEK_SET) >= 0;
 }
 
-uint8_t *lfsRead(uint32_t len) {
+uint8_t *lfsReadTo(uint8_t *dst, uint32_t len) {
     if (!_gzip) {
-        int ret = lfs_file_read(&_lfs, &_file, _flash_buff, len);
-        return (len == ret) ? _flash_buff : NULL;
+        int ret = lfs_file_read(&_lfs, &_file, dst, len);
+        return (len == ret) ? dst : NULL;
     }
-    m_uncomp.dest_start = _flash_buff;
-    m_uncomp.dest = _flash_buff;
-    m_uncomp.dest_limit = _flash_buff + len;
-    int res = uzlib_uncompress(&m_uncomp);
-    if ((res != TINF_DONE) && (res != TINF_OK)) {
-        return NULL;
+    uint8_t *p = otaInflateRead(dst, len);
+    if (p && (p != dst)) {
+        memcpy(dst, p, len);
+    }
+    return p ? dst : NULL;
+}
+
+// Full pages of compressed data are returned straight from the decompressor's window when
+// possible.  Callers always program a whole page, so short reads still go through _flash_buff.
+uint8_t *lfsRead(uint32_t len) {
+    if (!_gzip || (len < sizeof(_flash_buff))) {
+        return lfsReadTo(_flash_buff, len);
     }
-    return _flash_buff;
+    return otaInflateRead(_flash_buff, len);
 }
 
 void lfsClose() {
@@ -27,7 +27,9 @@ bool lfsMount(uint8_t *start, uint32_t blockSize, uint32_t size);
 bool lfsOpen(const char *filename);
 bool lfsSeek(uint32_t offset);
 uint8_t *lfsRead(uint32_t len);
+uint8_t *lfsReadTo(uint8_t *dst, uint32_t len);
 void lfsClose();
 
 bool lfsReadOTA(OTACmdPage *ota, uint32_t *blockToErase);
+uint8_t *lfsBlockFile(const char *filename);
 void lfsEraseBlock(uint32_t blockToErase);
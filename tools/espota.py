@@ -36,11 +36,14 @@ import optparse
 import logging
 import hashlib
 import random
+import gzip
 
 # Commands
 FLASH = 0
 SPIFFS = 100
 AUTH = 200
+# Newest upload protocol offered, see upload_windowed()
+PROTOCOL = 2
 PROGRESS = False
 # update_progress() : Displays or updates a console progress bar
 ## Accepts a float between 0 and 1. Any int will be converted to a float.
@@ -69,7 +72,56 @@ def update_progress(progress):
     sys.stderr.write('.')
     sys.stderr.flush()
 
-def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, command = FLASH):
+# Protocol 2 upload: keep up to window bytes in flight, in chunk sized writes, and read the
+# device's "A<bytes received>" cumulative acks as they arrive, instead of waiting for a reply
+# to every packet.  The device ends with "OK" or an error line once the image is checked.
+def upload_windowed(connection, payload, chunk, window):
+  size = len(payload)
+  sent = 0
+  acked = 0
+  pending = b''
+  if (PROGRESS):
+    update_progress(0)
+  else:
+    sys.stderr.write('Uploading')
+    sys.stderr.flush()
+  try:
+    connection.settimeout(10)
+    while True:
+      while sent < size and sent - acked < window:
+        n = min(chunk, size - sent)
+        connection.sendall(payload[sent:sent + n])
+        sent += n
+      if acked >= size:
+        # Update.end() checks the image and stages it
+        connection.settimeout(60)
+      data = connection.recv(64)
+      if not data:
+        raise Exception('Connection closed')
+      pending += data
+      while b'\n' in pending:
+        line, pending = pending.split(b'\n', 1)
+        line = line.decode().strip()
+        if line.startswith('A'):
+          acked = max(acked, int(line[1:]))
+          update_progress(acked / float(size))
+        elif line == 'OK':
+          sys.stderr.write('\n')
+          logging.info('Result: OK')
+          sys.stderr.write("Complete\n")
+          sys.stderr.flush()
+          return 0
+        elif line:
+          sys.stderr.write('\n')
+          logging.error('%s', line)
+          return 1
+  except Exception:
+    sys.stderr.write('\n')
+    logging.error('Error Uploading')
+    return 1
+# end upload_windowed
+
+def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, command = FLASH, protocol = PROTOCOL, compress = True):
   # Create a TCP/IP socket
   sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
   server_address = (localAddr, localPort)
@@ -91,10 +143,24 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
   
   content_size = os.path.getsize(filename)
   f = open(filename,'rb')
-  file_md5 = hashlib.md5(f.read()).hexdigest()
+  content = f.read()
+  file_md5 = hashlib.md5(content).hexdigest()
   f.close()
   logging.info('Upload size: %d', content_size)
   message = '%d %d %d %s\n' % (command, localPort, content_size, file_md5)
+  # Devices which understand it answer the second line with "OK <protocol> <chunk> <window>
+  # <gzip>", the last saying whether they took the compressed copy.  Signatures cover the
+  # image as sent, so signed and already compressed images go as they are.
+  zcontent = None
+  if compress and command == FLASH and not filename.endswith('.signed') and content[:2] != b'\x1f\x8b':
+    zcontent = gzip.compress(content, 9, mtime = 0)
+    if len(zcontent) >= content_size:
+      zcontent = None
+  if protocol >= 2:
+    if zcontent:
+      message += '%d %d %s\n' % (PROTOCOL, len(zcontent), hashlib.md5(zcontent).hexdigest())
+    else:
+      message += '%d 0 -\n' % (PROTOCOL)
 
   # Wait for a connection
   logging.info('Sending invitation to: %s', remoteAddr)
@@ -108,7 +174,7 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
     logging.error('No Answer')
     sock2.close()
     return 1
-  if (data != "OK"):
+  if (not data.startswith("OK")):
     if(data.startswith('AUTH')):
       nonce = data.split()[1]
       cnonce_text = '%s%u%s%s' % (filename, content_size, file_md5, remoteAddr)
@@ -128,7 +194,7 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
         logging.error('No Answer to our Authentication')
         sock2.close()
         return 1
-      if (data != "OK"):
+      if (not data.startswith("OK")):
         sys.stderr.write('FAIL\n')
         logging.error('%s', data)
         sock2.close()
@@ -140,6 +206,7 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
       sock2.close()
       return 1
   sock2.close()
+  reply = data.split()
 
   logging.info('Waiting for device...')
   try:
@@ -152,6 +219,16 @@ def serve(remoteAddr, localAddr, remotePort, localPort, password, filename, comm
     sock.close()
     return 1
 
+  if len(reply) >= 5 and int(reply[1]) >= 2:
+    payload = zcontent if reply[4] == '1' else content
+    logging.info('Protocol %s, sending %d bytes', reply[1], len(payload))
+    try:
+      ret = upload_windowed(connection, payload, int(reply[2]), int(reply[3]))
+    finally:
+      connection.close()
+      sock.close()
+    return ret
+
   received_ok = False
 
   try:
@@ -283,6 +360,18 @@ def parser(unparsed_args):
     help = "Use this option to transmit a SPIFFS image and do not flash the module.",
     default = False
   )
+  group.add_option("--no-compress",
+    dest = "compress",
+    action = "store_false",
+    help = "Do not offer the device a GZIP compressed copy of the image.",
+    default = True
+  )
+  group.add_option("--legacy",
+    dest = "legacy",
+    action = "store_true",
+    help = "Use the original upload protocol, waiting for a reply to each packet.",
+    default = False
+  )
   parser.add_option_group(group)
 
   # output group
@@ -336,7 +425,12 @@ def main(args):
     command = SPIFFS
   # end if
 
-  return serve(options.esp_ip, options.host_ip, options.esp_port, options.host_port, options.auth, options.image, command)
+  protocol = PROTOCOL
+  if (options.legacy):
+    protocol = 1
+  # end if
+
+  return serve(options.esp_ip, options.host_ip, options.esp_port, options.host_port, options.auth, options.image, command, protocol, options.compress)
 # end main
 
 
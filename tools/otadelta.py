@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Generates (and, for testing, applies) delta patches for the OTA bootloader.  The
+# patch is uploaded in place of firmware.bin, optionally GZIP compressed, and the
+# bootloader rebuilds the new image page by page from the one already in flash.
+#
+# See ota/ota_command.h for the format.  Because the bootloader overwrites the old
+# image as it goes, every page may only copy from parts of the old image which are
+# still intact at that point.  Both write orders are tried and the smaller kept.
+#
+# Only a bootloader rebuilt from the ota/ sources applies these.  The prebuilt lib/ota.o
+# shipped with the core would copy the patch itself into flash, so don't upload one to it.
+
+import argparse
+import gzip
+import struct
+import sys
+import zlib
+
+PAGE = 4096
+MAGIC = 0x46494450
+DESCENDING = 1
+KEY = 8          # Bytes hashed to find match candidates
+MAX_CAND = 16    # Candidates kept per key
+
+
+def crc32(data):
+    return zlib.crc32(data) & 0xffffffff
+
+
+def build_index(old):
+    index = {}
+    for i in range(0, len(old) - KEY + 1, 2):
+        lst = index.setdefault(old[i:i + KEY], [])
+        if len(lst) < MAX_CAND:
+            lst.append(i)
+    return index
+
+
+def extend(old, new, s, p, end, lo, hi):
+    """Length of the best approximate match of new[p:end] against old[s:], bsdiff style:
+    keep going while matching bytes outnumber mismatches since the start."""
+    limit = min(end - p, hi - s)
+    if s < lo or limit <= 0:
+        return 0
+    n = 0
+    # Fast path over identical runs
+    while n + 64 <= limit and old[s + n:s + n + 64] == new[p + n:p + n + 64]:
+        n += 64
+    score = best_score = n
+    best = n
+    i = n
+    while i < limit:
+        score += 1 if old[s + i] == new[p + i] else -1
+        i += 1
+        if score > best_score:
+            best_score = score
+            best = i
+        elif score < best_score - 16:
+            break
+    return best
+
+
+def diff_page(old, new, index, start, end, lo, hi, state):
+    """Ops for new[start:end] using only old[lo:hi]."""
+    ops = []
+    p = start
+    lit = bytearray()
+    cur = None  # (srcOffset, bytes of diff)
+
+    def flush():
+        nonlocal cur, lit
+        if cur or lit:
+            src, d = cur if cur else (0, b'')
+            ops.append((src, bytes(d), bytes(lit)))
+        cur = None
+        lit = bytearray()
+
+    while p < end:
+        best_len = 0
+        best_src = 0
+        # Keep the previous alignment while it works, it's the common case for code
+        s = p + state[0]
+        n = extend(old, new, s, p, end, lo, hi)
+        if n >= KEY:
+            best_len, best_src = n, s
+        else:
+            for c in index.get(new[p:p + KEY], ()):
+                n = extend(old, new, c, p, end, lo, hi)
+                if n > best_len:
+                    best_len, best_src = n, c
+        if best_len >= KEY:
+            flush()
+            d = bytes((new[p + i] - old[best_src + i]) & 0xff for i in range(best_len))
+            cur = (best_src, d)
+            state[0] = best_src - p
+            p += best_len
+        else:
+            lit.append(new[p])
+            p += 1
+    flush()
+    return ops
+
+
+def make_patch(old, new, descending):
+    index = build_index(old)
+    out = bytearray(struct.pack('<6I', MAGIC, DESCENDING if descending else 0, len(old), crc32(old), len(new), crc32(new)))
+    pages = (len(new) + PAGE - 1) // PAGE
+    order = range(pages - 1, -1, -1) if descending else range(pages)
+    state = [0]
+    for page in order:
+        start = page * PAGE
+        end = min(start + PAGE, len(new))
+        if descending:
+            lo, hi = 0, min(start + PAGE, len(old))
+        else:
+            lo, hi = start, len(old)
+        for src, d, lit in diff_page(old, new, index, start, end, lo, hi, state):
+            out += struct.pack('<3I', len(d), src, len(lit)) + d + lit
+        out += struct.pack('<I', crc32(new[start:end]))
+    return bytes(out)
+
+
+def apply_patch(flash, patch, fail_after=None):
+    """Applies in place exactly like the bootloader's programming pass, optionally
+    "losing power" after fail_after pages have been programmed."""
+    magic, flags, src_len, src_crc, dst_len, dst_crc = struct.unpack_from('<6I', patch, 0)
+    if magic != MAGIC:
+        raise ValueError('not a patch')
+    pos = 24
+    pages = (dst_len + PAGE - 1) // PAGE
+    if len(flash) < pages * PAGE:
+        flash.extend(b'\xff' * (pages * PAGE - len(flash)))
+    written = 0
+    for n in range(pages):
+        page = pages - 1 - n if flags & DESCENDING else n
+        start = page * PAGE
+        length = min(PAGE, dst_len - start)
+        buf = bytearray(b'\xff' * PAGE)
+        o = 0
+        while o < length:
+            dlen, src, elen = struct.unpack_from('<3I', patch, pos)
+            pos += 12
+            if flags & DESCENDING:
+                assert src + dlen <= start + PAGE, 'source already overwritten'
+            else:
+                assert dlen == 0 or src >= start, 'source already overwritten'
+            for i in range(dlen):
+                buf[o + i] = (patch[pos + i] + flash[src + i]) & 0xff
+            pos += dlen
+            o += dlen
+            buf[o:o + elen] = patch[pos:pos + elen]
+            pos += elen
+            o += elen
+        crc, = struct.unpack_from('<I', patch, pos)
+        pos += 4
+        if crc32(bytes(flash[start:start + length])) == crc:
+            continue
+        if crc32(bytes(buf[:length])) != crc:
+            raise ValueError('page 0x%x does not match' % start)
+        if fail_after is not None and written == fail_after:
+            # Erased but never programmed
+            flash[start:start + PAGE] = b'\xff' * PAGE
+            return False
+        flash[start:start + PAGE] = buf
+        written += 1
+    if crc32(bytes(flash[:dst_len])) != dst_crc:
+        raise ValueError('final CRC mismatch')
+    return True
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='OTA delta patch tool')
+    parser.add_argument('-m', '--mode', help='Mode (diff, apply)')
+    parser.add_argument('-O', '--old', help='Image currently on the device')
+    parser.add_argument('-n', '--new', help='New image (diff mode)')
+    parser.add_argument('-p', '--patch', help='Patch file (input for apply mode)')
+    parser.add_argument('-o', '--out', help='Output file')
+    parser.add_argument('-z', '--gzip', action='store_true', help='GZIP compress the generated patch')
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    with open(args.old, 'rb') as f:
+        old = f.read()
+    if args.mode == 'diff':
+        with open(args.new, 'rb') as f:
+            new = f.read()
+        best = None
+        for descending in (False, True):
+            patch = make_patch(old, new, descending)
+            packed = gzip.compress(patch, 9)
+            if best is None or len(packed) < len(best[1]):
+                best = (patch, packed)
+        data = best[1] if args.gzip else best[0]
+        with open(args.out, 'wb') as f:
+            f.write(data)
+        sys.stderr.write('Patch: %d bytes (%d compressed) for a %d byte image\n' % (len(best[0]), len(best[1]), len(new)))
+        return 0
+    elif args.mode == 'apply':
+        with open(args.patch, 'rb') as f:
+            patch = f.read()
+        if patch[:2] == b'\x1f\x8b':
+            patch = gzip.decompress(patch)
+        flash = bytearray(old)
+        apply_patch(flash, patch)
+        dst_len, = struct.unpack_from('<I', patch, 16)
+        with open(args.out, 'wb') as f:
+            f.write(flash[:dst_len])
+        return 0
+    else:
+        sys.stderr.write("ERROR: Mode not specified as diff or apply\n")
+        return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())